@@ -2,10 +2,17 @@
 #define CORRECTION_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <variant>
 #include <map>
 #include <memory>
+#include <optional>
+#include <array>
+#include <type_traits>
+#if __has_include(<span>)
+#include <span>
+#endif
 #include "correctionlib_version.h"
 
 namespace correction {
@@ -27,6 +34,7 @@ class Variable {
     VarType type() const { return type_; };
     std::string typeStr() const;
     void validate(const Type& t) const;
+    void validate(VarType t) const;
 
     static Variable from_string(const char * data);
 
@@ -36,6 +44,148 @@ class Variable {
     VarType type_;
 };
 
+// A single input value, as passed to the nodes of a correction.
+// Unlike Variable::Type it does not own string data, and it is trivially copyable.
+class InputValue {
+    template<typename T>
+    static constexpr bool is_integer_v = std::is_integral_v<T>
+      && !std::is_same_v<T, bool> && !std::is_same_v<T, char>
+      && !std::is_same_v<T, signed char> && !std::is_same_v<T, unsigned char>
+      && !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>;
+
+  public:
+    InputValue(double value) : type_(Variable::VarType::real), real_(value) {};
+    template<typename T, std::enable_if_t<is_integer_v<T>, int> = 0>
+    InputValue(T value) : type_(Variable::VarType::integer), integer_(static_cast<int64_t>(value)) {}
+    // bool and the character types are not integer inputs, rather than converting silently
+    template<typename T, std::enable_if_t<std::is_integral_v<T> && !is_integer_v<T>, int> = 0>
+    InputValue(T value) = delete;
+    InputValue(std::string_view value) : type_(Variable::VarType::string), string_{value.data(), value.size()} {};
+    InputValue(const char * value) : InputValue(std::string_view(value)) {};
+    InputValue(const std::string& value) : InputValue(std::string_view(value)) {};
+    // views the string alternative in place
+    InputValue(const Variable::Type& value);
+
+    Variable::VarType type() const { return type_; };
+    // unchecked accessors: the type must be known to match
+    int64_t integer() const { return integer_; };
+    double real() const { return real_; };
+    std::string_view string() const { return {string_.data, string_.size}; };
+    // value of an integer or real input
+    double number() const {
+      return ( type_ == Variable::VarType::integer ) ? static_cast<double>(integer_) : real_;
+    };
+
+  private:
+    Variable::VarType type_;
+    union {
+      int64_t integer_;
+      double real_;
+      struct { const char * data; size_t size; } string_;
+    };
+};
+
+// A column of inputs for batch evaluation: either an array with one value
+// per entry, or a single value shared by all entries. Does not own the data.
+class InputColumn {
+  public:
+    InputColumn(InputValue value) : type_(value.type()), data_(nullptr), value_(value) {};
+    InputColumn(const double * data) : type_(Variable::VarType::real), data_(data), value_(0.) {};
+    // real values in single precision, widened as they are read
+    InputColumn(const float * data) : type_(Variable::VarType::real), data_(data), value_(0.), single_(true) {};
+    InputColumn(const int64_t * data) : type_(Variable::VarType::integer), data_(data), value_(0.) {};
+    InputColumn(const std::string_view * data) : type_(Variable::VarType::string), data_(data), value_(0.) {};
+
+    Variable::VarType type() const { return type_; };
+    bool broadcast() const { return data_ == nullptr; };
+    // real values stored as float rather than double
+    bool single() const { return single_; };
+    // the array, of the element type matching type() (float if single()), null if broadcast
+    const void * data() const { return data_; };
+    // the entries from start on
+    InputColumn offset(size_t start) const {
+      if ( data_ == nullptr ) return *this;
+      switch ( type_ ) {
+        case Variable::VarType::real:
+          if ( single_ ) return static_cast<const float*>(data_) + start;
+          return static_cast<const double*>(data_) + start;
+        case Variable::VarType::integer: return static_cast<const int64_t*>(data_) + start;
+        default: return static_cast<const std::string_view*>(data_) + start;
+      }
+    };
+    InputValue operator[](size_t i) const {
+      if ( data_ == nullptr ) return value_;
+      switch ( type_ ) {
+        case Variable::VarType::real:
+          if ( single_ ) return static_cast<double>(static_cast<const float*>(data_)[i]);
+          return static_cast<const double*>(data_)[i];
+        case Variable::VarType::integer: return static_cast<const int64_t*>(data_)[i];
+        default: return static_cast<const std::string_view*>(data_)[i];
+      }
+    };
+
+  private:
+    Variable::VarType type_;
+    const void * data_;
+    InputValue value_;
+    bool single_ = false;
+};
+
+namespace detail {
+  class BinIndexCache; // bin indices shared between corrections, see CorrectionSet::evaluate_many
+  class ScratchArena; // scratch memory of an EvaluationContext
+
+  // The inputs of a correction as seen by its nodes, already validated.
+  // A view can replace one input of another view (see Transform), which
+  // does not copy the other inputs.
+  class InputView {
+    public:
+      explicit InputView(const InputValue * values) : values_(values), parent_(nullptr), replaced_(static_cast<size_t>(-1)), value_(0.) {};
+      InputView(const InputView& parent, size_t idx, InputValue value) :
+        values_(parent.values_), parent_(&parent), replaced_(idx), value_(value) {};
+      const InputValue& operator[](size_t idx) const {
+        if ( idx == replaced_ ) return value_;
+        if ( parent_ != nullptr ) return (*parent_)[idx];
+        return values_[idx];
+      };
+
+    private:
+      const InputValue * values_;
+      const InputView * parent_;
+      size_t replaced_;
+      InputValue value_;
+  };
+
+  // The inputs of a correction for a batch of entries, already validated
+  class BatchView {
+    public:
+      BatchView(const InputColumn * columns, size_t ncolumns, size_t size, BinIndexCache * bin_indices = nullptr,
+          ScratchArena * scratch = nullptr) :
+        columns_(columns), ncolumns_(ncolumns), size_(size), bin_indices_(bin_indices), scratch_(scratch) {};
+      const InputColumn& operator[](size_t idx) const { return columns_[idx]; };
+      const InputColumn * columns() const { return columns_; };
+      size_t ncolumns() const { return ncolumns_; };
+      // number of entries
+      size_t size() const { return size_; };
+      void gather(size_t i, InputValue * row) const {
+        for (size_t j=0; j < ncolumns_; ++j) row[j] = columns_[j][i];
+      };
+      // bin indices of these columns computed by other corrections, or null.
+      // Views over other columns (gathered, transformed) do not pass it on
+      BinIndexCache * bin_indices() const { return bin_indices_; };
+      // memory for the temporary buffers of the nodes, or null to use the
+      // heap. Views derived from this one pass it on
+      ScratchArena * scratch() const { return scratch_; };
+
+    private:
+      const InputColumn * columns_;
+      size_t ncolumns_;
+      size_t size_;
+      BinIndexCache * bin_indices_;
+      ScratchArena * scratch_;
+  };
+}
+
 class Formula;
 class FormulaRef;
 class Transform;
@@ -44,8 +194,19 @@ class LWTNN;
 class Binning;
 class MultiBinning;
 class Category;
-typedef std::variant<double, Formula, FormulaRef, Transform, HashPRNG, LWTNN, Binning, MultiBinning, Category> Content;
+class Tabulated;
+typedef std::variant<double, Formula, FormulaRef, Transform, HashPRNG, LWTNN, Binning, MultiBinning, Category, Tabulated> Content;
 class Correction;
+template<typename... Ts> class BoundCorrection;
+
+namespace detail {
+  struct Specialization; // fixed inputs for Correction::specialize
+  struct Tabulation; // options and report of Correction::tabulated
+  class EvaluationCache; // memoized results for Correction::cached
+  class VariationFanout; // shared routing for Correction::evaluate_variations
+  class EdgesTable; // bin edges shared within a CorrectionSet
+  struct SameContent; // equality of subtrees for Correction::coalesced
+}
 
 class FormulaAst {
   public:
@@ -120,8 +281,18 @@ class FormulaAst {
     const NodeData &data() const { return data_; }
     const Children& children() const { return children_; }
     double evaluate(const std::vector<Variable::Type>& variables, const std::vector<double>& parameters) const;
+    double evaluate(const detail::InputView& variables, const std::vector<double>& parameters) const;
+    // the same for each entry of a batch, writing to out[0, variables.size())
+    void evaluate(const detail::BatchView& variables, const std::vector<double>& parameters, double * out) const;
+    // substitute fixed variables and fold the constant subtrees
+    FormulaAst specialize(const detail::Specialization& spec) const;
 
   private:
+    // entries [start, start + n) of a batch, with scratch space for the
+    // intermediate results of the deeper nodes
+    void evaluate(const detail::BatchView& variables, const std::vector<double>& parameters,
+        size_t start, size_t n, double * out, double * scratch) const;
+
     NodeType nodetype_;
     NodeData data_;
     Children children_;
@@ -137,10 +308,17 @@ class Formula {
     const FormulaAst &ast() const { return *ast_; };
     double evaluate(const std::vector<Variable::Type>& values) const;
     double evaluate(const std::vector<Variable::Type>& values, const std::vector<double>& parameters) const;
+    double evaluate(const detail::InputView& values) const;
+    double evaluate(const detail::InputView& values, const std::vector<double>& parameters) const;
+    void evaluate(const detail::BatchView& values, double * out) const;
+    void evaluate(const detail::BatchView& values, const std::vector<double>& parameters, double * out) const;
+    Formula specialize(const detail::Specialization& spec) const;
 
     static Ref from_string(const char * data, std::vector<Variable>& inputs);
 
   private:
+    Formula() = default;
+
     std::string expression_;
     FormulaAst::ParserType type_;
     std::unique_ptr<FormulaAst> ast_;
@@ -150,9 +328,16 @@ class Formula {
 class FormulaRef {
   public:
     FormulaRef(const JSONObject& json, const Correction& context);
-    double evaluate(const std::vector<Variable::Type>& values) const;
+    double evaluate(const detail::InputView& values) const;
+    void evaluate(const detail::BatchView& values, double * out) const;
+    Content specialize(const detail::Specialization& spec) const;
+    const Formula& formula() const { return *formula_; };
 
   private:
+    friend struct detail::SameContent;
+    FormulaRef() = default;
+
+    size_t index_; // position in the context generic formulas
     Formula::Ref formula_;
     std::vector<double> parameters_;
 };
@@ -160,9 +345,14 @@ class FormulaRef {
 class Transform {
   public:
     Transform(const JSONObject& json, const Correction& context);
-    double evaluate(const std::vector<Variable::Type>& values) const;
+    double evaluate(const detail::InputView& values) const;
+    void evaluate(const detail::BatchView& values, double * out) const;
+    Content specialize(const detail::Specialization& spec) const;
 
   private:
+    friend struct detail::SameContent;
+    Transform() = default;
+
     size_t variableIdx_;
     std::unique_ptr<const Content> rule_;
     std::unique_ptr<const Content> content_;
@@ -171,11 +361,19 @@ class Transform {
 class HashPRNG {
   public:
     HashPRNG(const JSONObject& json, const Correction& context);
-    double evaluate(const std::vector<Variable::Type>& values) const;
+    double evaluate(const detail::InputView& values) const;
+    void evaluate(const detail::BatchView& values, double * out) const;
+    Content specialize(const detail::Specialization& spec) const;
 
   private:
+    HashPRNG() = default;
+    // draw from the distribution with a generator seeded by the hash of the inputs
+    double generate(uint64_t seed) const;
+
     enum class Distribution { stdflat, stdnormal, normal };
-    std::vector<size_t> variablesIdx_;
+    static constexpr size_t fixed_input = static_cast<size_t>(-1);
+    std::vector<size_t> variablesIdx_; // fixed_input where the seed word is in fixedSeeds_
+    std::vector<uint64_t> fixedSeeds_; // empty unless specialized
     Distribution dist_;
 };
 
@@ -187,7 +385,11 @@ namespace detail {
 class LWTNN {
   public:
     LWTNN(const JSONObject& json, const Correction& context);
-    double evaluate(const std::vector<Variable::Type>& values) const;
+    double evaluate(const detail::InputView& values) const;
+    void evaluate(const detail::BatchView& values, double * out) const;
+    Content specialize(const detail::Specialization& spec) const;
+    // the inputs read by the network
+    std::vector<size_t> variables() const;
 
     // this variant is in a separate source file, so move/delete needs to be explicit
     // TODO: eventually break all the Content variants into separate source files
@@ -196,14 +398,47 @@ class LWTNN {
     LWTNN& operator=(LWTNN&&);
 
   private:
+    LWTNN();
+
     std::unique_ptr<const detail::LWTNNEvaluationContext> model_;
 };
 
+// A smooth node (Formula, FormulaRef, LWTNN) of one or two real inputs,
+// replaced by Correction::tabulated with a linear interpolation table on a
+// uniform grid of its inputs. Entries outside the grid use the node itself.
+class Tabulated {
+  public:
+    double evaluate(const detail::InputView& values) const;
+    void evaluate(const detail::BatchView& values, double * out) const;
+    Content specialize(const detail::Specialization& spec) const;
+    // node as is, or a Tabulated of it if it is a candidate and its table
+    // meets the tolerance of spec.tabulation
+    static Content tabulate(Content&& node, const detail::Specialization& spec);
+
+  private:
+    Tabulated() = default;
+
+    struct Axis {
+      size_t variableIdx;
+      size_t n; // grid points, from low to high included
+      double low;
+      double high;
+      double scale; // (n-1)/(high-low)
+    };
+    // x[k] are the values on the axes, inside the grid
+    double interpolate(const double * x) const;
+
+    std::vector<Axis> axes_;
+    std::shared_ptr<const std::vector<double>> values_; // on the grid, the last axis varies fastest
+    std::unique_ptr<const Content> node_;
+};
+
 namespace detail {
   // common internal for Binning and MultiBinning
   enum class FlowBehavior {value, clamp, error, wrap};
 
-  using NonUniformBins = std::vector<double>;
+  // immutable, identical edges are shared within a CorrectionSet
+  using NonUniformBins = std::shared_ptr<const std::vector<double>>;
 
   struct UniformBins {
     std::size_t n; // number of bins
@@ -217,13 +452,28 @@ namespace detail {
 class Binning {
   public:
     Binning(const JSONObject& json, const Correction& context);
-    double evaluate(const std::vector<Variable::Type>& values) const;
+    double evaluate(const detail::InputView& values) const;
+    // routes the entries to the bins, then evaluates each bin once
+    void evaluate(const detail::BatchView& values, double * out) const;
+    Content specialize(const detail::Specialization& spec) const;
 
   private:
+    friend class detail::VariationFanout;
+    friend struct detail::SameContent;
+    friend class MultiBinning; // for fused
+    Binning() = default;
+
+    // bin index of each entry, as find_bin_idx, or a failure past the contents
+    void route(const detail::BatchView& values, size_t * out) const;
+    // merge adjacent bins with the same contents, adding the edges removed
+    void coalesce(const Correction& context, size_t& removed);
+
     detail::EdgesType bins_; // bin edges
     // bin contents: contents_[i] is the value corresponding to bins_[i+1].
     // the default value is at contents_[0]
     std::vector<Content> contents_;
+    // the same when all contents are constants, contents_ is then empty
+    std::vector<double> values_;
     size_t variableIdx_;
     detail::FlowBehavior flow_;
 };
@@ -233,6 +483,19 @@ namespace detail {
     size_t variableIdx;
     size_t stride;
     detail::EdgesType bins;
+    // lookup descriptor, precomputed from bins at construction
+    size_t nbins;
+    double low; // lower edge of the first bin
+    double high; // upper edge of the last bin
+    double scale; // uniform bins: nbins / (high - low), the inverse bin width
+    double tolerance; // uniform bins: scaled values closer than this to an edge use the exact formula
+    bool linear; // non-uniform bins: few enough edges for a linear search
+  };
+  // 64 cells of a sparse MultiBinning: a bit for each cell with its own
+  // content, and the number of such cells before them
+  struct SparseCells {
+    uint64_t mask;
+    size_t before;
   };
 }
 
@@ -240,29 +503,143 @@ class MultiBinning {
   public:
     MultiBinning(const JSONObject& json, const Correction& context);
     size_t ndimensions() const { return axes_.size(); };
-    double evaluate(const std::vector<Variable::Type>& values) const;
+    // are the cells stored sparse, see sparse_
+    bool sparse() const { return ! sparse_.empty(); };
+    double evaluate(const detail::InputView& values) const;
+    // routes the entries to the bins, then evaluates each bin once
+    void evaluate(const detail::BatchView& values, double * out) const;
+    Content specialize(const detail::Specialization& spec) const;
+    // a Binning or MultiBinning whose bins all hold binnings on the same axes,
+    // with the same flow and default, as one MultiBinning over all the axes.
+    // Any other node is returned as is
+    static Content fused(Content&& node);
 
   private:
-    size_t nbins(size_t dimension) const;
+    friend class detail::VariationFanout;
+    friend struct detail::SameContent;
+    MultiBinning() = default;
+
+    size_t nbins(size_t dimension) const { return axes_[dimension].nbins; };
+    // cells are numbered in row-major order of the axes, the default value
+    // (or the last cell if there is none) is cell ncells() - 1
+    size_t ncells() const;
+    // position of a cell in content_ (or values_)
+    size_t slot(size_t cell) const;
+    // bin index along an axis, nbins for the default value (as find_bin_idx),
+    // and SIZE_MAX where find_bin_idx raises
+    size_t local_index(const detail::MultiBinningAxis& axis, double value) const;
+    // cell of each entry, or a failure past the cells
+    void route(const detail::BatchView& values, size_t * out) const;
+    // switch to sparse storage if most cells hold the same constant
+    void sparsify();
+    // merge adjacent bins of an axis with the same contents, adding the edges removed
+    void coalesce(const Correction& context, size_t& removed);
 
     std::vector<detail::MultiBinningAxis> axes_;
     std::vector<Content> content_;
+    // the same when all contents are constants, content_ is then empty
+    std::vector<double> values_;
+    // for sparse storage, empty otherwise: the cells that do not hold the most
+    // common constant, and the default value. content_ (or values_) holds that
+    // constant, then the contents of these cells in order
+    std::vector<detail::SparseCells> sparse_;
     detail::FlowBehavior flow_;
 };
 
+namespace detail {
+  // Category key lookup tables, chosen at construction time from the keys.
+  // Each maps a key to a position in the category content, see Category::find
+  struct DenseIntTable {
+    int64_t offset; // smallest key
+    std::vector<uint32_t> slots; // slots[key - offset]
+  };
+
+  // open addressing, linear probing
+  struct IntHashTable {
+    unsigned shift; // home slot is (key * 2^64/phi) >> shift
+    std::vector<int64_t> keys;
+    std::vector<uint32_t> slots;
+  };
+
+  // open addressing, linear probing, with the key hashes stored alongside
+  struct StrHashTable {
+    uint64_t mask; // home slot is hash & mask
+    std::vector<uint64_t> hashes;
+    std::vector<std::string> keys;
+    std::vector<uint32_t> slots;
+  };
+
+  using CategoryTable = std::variant<DenseIntTable, IntHashTable, StrHashTable>;
+}
+
 class Category {
   public:
     Category(const JSONObject& json, const Correction& context);
-    double evaluate(const std::vector<Variable::Type>& values) const;
+    double evaluate(const detail::InputView& values) const;
+    // routes the entries to the categories, then evaluates each category once
+    void evaluate(const detail::BatchView& values, double * out) const;
+    Content specialize(const detail::Specialization& spec) const;
 
   private:
-    typedef std::map<int64_t, Content> IntMap;
-    typedef std::map<std::string, Content> StrMap;
-    std::variant<IntMap, StrMap> map_;
+    friend class detail::VariationFanout;
+    friend struct detail::SameContent;
+    Category() = default;
+
+    // position of the key in content_, or content_.size() if not present
+    size_t find(int64_t key) const;
+    size_t find(std::string_view key) const;
+    // as find, throws if the key is not present and there is no default
+    size_t position(const InputValue& value) const;
+    // position of each entry, or a failure past the contents
+    void route(const detail::BatchView& values, size_t * out) const;
+    const Content& child(size_t pos) const { return ( pos < content_.size() ) ? content_[pos] : *default_; };
+
+    detail::CategoryTable table_;
+    std::vector<Content> content_;
     std::unique_ptr<const Content> default_;
     size_t variableIdx_;
 };
 
+// Scratch memory for evaluate and evaluate_batch, for callers that manage it
+// themselves (e.g. one per task of a thread pool) instead of relying on the
+// per-thread buffers of the overloads without a context. The buffers grow to
+// the largest evaluation and are then reused, so that batches of similar size
+// do not allocate. A context can be passed to any correction, but must only
+// be used by one thread at a time.
+class EvaluationContext {
+  public:
+    // if count is true, stats() counts the evaluations made with this context
+    explicit EvaluationContext(bool count = false);
+    ~EvaluationContext();
+    EvaluationContext(const EvaluationContext&) = delete;
+    EvaluationContext& operator=(const EvaluationContext&) = delete;
+    struct Stats {
+      // calls to Correction::evaluate and evaluate_batch, including those
+      // made by a CompoundCorrection, zero if not counted
+      uint64_t evaluations;
+      uint64_t entries; // evaluated by those calls
+      size_t scratch_bytes; // held for the next evaluations
+    };
+    Stats stats() const;
+    // frees the scratch memory, which is otherwise kept until destruction
+    void release();
+
+  private:
+    friend class Correction;
+    friend class CompoundCorrection;
+    void count(size_t entries) {
+      if ( count_ ) { ++evaluations_; entries_ += entries; }
+    };
+
+    bool count_;
+    uint64_t evaluations_ = 0;
+    uint64_t entries_ = 0;
+    std::vector<InputValue> converted_; // the Variable::Type inputs of evaluate
+    std::vector<InputValue> updated_; // for CompoundCorrection, the inputs as updated so far
+    std::vector<InputValue> selected_; // and those of the current correction
+    std::unique_ptr<detail::ScratchArena> arena_;
+};
+
 class Correction {
   public:
     typedef std::shared_ptr<const Correction> Ref;
@@ -275,8 +652,134 @@ class Correction {
     Formula::Ref formula_ref(size_t idx) const { return formula_refs_.at(idx); };
     const Variable& output() const { return output_; };
     double evaluate(const std::vector<Variable::Type>& values) const;
+    // as above, converting the inputs in the buffers of context
+    double evaluate(const std::vector<Variable::Type>& values, EvaluationContext& context) const;
+    // does not allocate, unless it throws
+    double evaluate(const InputValue * values, size_t size) const;
+    double evaluate(const InputValue * values, size_t size, EvaluationContext& context) const;
+#ifdef __cpp_lib_span
+    double evaluate(std::span<const InputValue> values) const { return evaluate(values.data(), values.size()); };
+#endif
+    // Evaluate size entries at once, one column per input, writing to out[0, size)
+    void evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out) const;
+    // as above, with the temporary buffers of the nodes taken from context
+    // rather than the heap
+    void evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out,
+        EvaluationContext& context) const;
+#ifdef __cpp_lib_span
+    void evaluate_batch(std::span<const InputColumn> columns, std::span<double> out) const {
+      evaluate_batch(columns.data(), columns.size(), out.size(), out.data());
+    };
+#endif
+    // As above, with the results rounded to single precision, one block at a time
+    void evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, float * out) const;
+    // Why an entry of a batch could not be evaluated
+    enum class EntryStatus : uint8_t {
+      ok,
+      out_of_range, // an input outside the edges of a binning with flow: error
+      missing_key, // a key not in a category without default
+    };
+    // As evaluate_batch, but entries that cannot be evaluated do not raise:
+    // their output is fill (e.g. NaN) and, if status is not null, status[i]
+    // tells why. Only the inputs (number, types) are checked up front and raise
+    void evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out,
+        double fill, EntryStatus * status = nullptr) const;
+    // As above, with the results rounded to single precision, one block at a time
+    void evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, float * out,
+        double fill, EntryStatus * status = nullptr) const;
+    // Evaluate the correction for each of keys as the value of the string
+    // input input_name, writing the result for keys[k] to out[k*size, (k+1)*size).
+    // columns are those of the other inputs, in order. Binnings that are the
+    // same for all keys (e.g. below a category of systematic variations) route
+    // each entry once, then read the value of every key.
+    void evaluate_variations(const std::string& input_name, const std::vector<std::string>& keys,
+        const InputColumn * columns, size_t ncolumns, size_t size, double * out) const;
+    // Evaluate the correction on the outer product of points per input:
+    // axes[j] holds the sizes[j] points of input j, and out, of the product
+    // of sizes entries, is the row-major array with the last input fastest.
+    // The product of the inputs is not built: the correction is evaluated in
+    // batches over the last inputs, with one point of the others each, and
+    // the bin indices of the last inputs are reused between batches.
+    void evaluate_grid(const InputColumn * axes, const size_t * sizes, size_t ncolumns, double * out) const;
+    // A new correction with the given inputs fixed to the given values and
+    // removed from its inputs. Nodes that only depend on fixed inputs are
+    // resolved here, so the result is (usually) smaller and faster to evaluate.
+    Ref specialize(const std::map<std::string, Variable::Type>& values) const;
+    // A copy in which adjacent bins with identical contents (constants, or
+    // subtrees of the same structure) are merged, for fewer edges to search
+    // and smaller tables. Only the inner edges of non-uniform binnings are
+    // removed, so results and flow behavior are unchanged. If removed is not
+    // null, it is set to the number of edges removed.
+    Ref coalesced(size_t * removed = nullptr) const;
+    // A callable taking the inputs as plain values of types Ts (double,
+    // int64_t, or std::string_view for string inputs), which are checked
+    // against the inputs here rather than on every call
+    template<typename... Ts>
+    BoundCorrection<Ts...> bind() const;
+    // A copy of this correction that remembers up to capacity results per
+    // thread, keyed on the exact input values. Worthwhile when evaluation is
+    // expensive (neural networks, long formulas) and inputs repeat. Each
+    // thread allocates its table on first use, and a miss may allocate.
+    Ref cached(size_t capacity) const;
+    struct CacheStats {
+      size_t capacity; // zero if not cached
+      uint64_t hits;
+      uint64_t misses;
+    };
+    // summed over all threads
+    CacheStats cache_stats() const;
+    struct TabulationOptions {
+      double tolerance; // largest absolute error allowed on the check sample
+      std::map<std::string, std::pair<double, double>> domains; // range of real inputs, by name
+      size_t max_points = 65536; // per table
+    };
+    struct TabulationEntry {
+      std::string node; // "formula", "formularef" or "lwtnn"
+      std::vector<std::string> inputs;
+      std::vector<std::pair<double, double>> domain;
+      size_t points; // of the last grid tried, zero if the domain is not bounded
+      double max_error; // on the check sample of that grid
+      size_t bytes; // of its table
+      bool tabulated;
+    };
+    // A copy in which the smooth nodes (formulas, neural networks) of one or
+    // two real inputs are replaced by interpolation tables, when the error
+    // stays within options.tolerance. Each node is sampled over the domains
+    // of its inputs, narrowed by the binnings above it, on finer grids until
+    // a check sample between the grid points meets the tolerance or the grid
+    // would exceed max_points. Values outside the grid are evaluated exactly.
+    // report, if given, gets one entry per candidate node
+    Ref tabulated(const TabulationOptions& options, std::vector<TabulationEntry> * report = nullptr) const;
 
   private:
+    template<typename...> friend class BoundCorrection;
+    friend class CorrectionSet;
+    friend class Binning;
+    friend class MultiBinning;
+    // for CorrectionSet, which shares identical bin edges between its corrections
+    Correction(const JSONObject& json, detail::EdgesTable * edges);
+    // non-uniform bin edges, shared if an identical set was seen before
+    detail::NonUniformBins edges(std::vector<double>&& edges) const;
+    // throws if the inputs do not have these types
+    void check_signature(const Variable::VarType * types, size_t n) const;
+    // throws if the columns do not match the inputs
+    void check_columns(const InputColumn * columns, size_t ncolumns) const;
+    double evaluate_unchecked(const InputValue * values) const;
+    double evaluate_uncached(const InputValue * values) const;
+    // evaluate_batch after checking the inputs. Entries that cannot be
+    // evaluated are marked in out rather than raising, see raise_failed
+    void evaluate_view(const detail::BatchView& view, double * out) const;
+    // evaluate the entries marked as failed again, which raises as evaluate does
+    void raise_failed(const detail::BatchView& view, double * out) const;
+
+    // for specialize: the metadata of other with a subset of its inputs, no data yet
+    Correction(const Correction& other, std::vector<Variable>&& inputs);
+    // a copy with the fixed inputs resolved and removed, the smooth nodes
+    // tabulated if tabulation is given, and the bins merged if coalesced is
+    // given, which counts the edges removed
+    std::shared_ptr<Correction> specialize_inputs(std::vector<std::optional<Variable::Type>>&& fixed,
+        const detail::Tabulation * tabulation = nullptr, size_t * coalesced = nullptr) const;
+
     std::string name_;
     std::string description_;
     int version_;
@@ -285,9 +788,49 @@ class Correction {
     std::vector<Formula::Ref> formula_refs_;
     bool initialized_; // is data_ filled?
     Content data_;
+    std::shared_ptr<detail::EvaluationCache> cache_; // null if not cached
+    detail::EdgesTable * edges_table_ = nullptr; // only while loading from a CorrectionSet
 };
 
 typedef Correction::Ref CorrectionPtr; // deprecated
+
+// A Correction with a fixed signature, see Correction::bind.
+// Only holds a pointer to the correction, which must outlive it.
+template<typename... Ts>
+class BoundCorrection {
+  public:
+    double operator()(Ts... values) const {
+      const std::array<InputValue, sizeof...(Ts)> inputs {InputValue(values)...};
+      return correction_->evaluate_unchecked(inputs.data());
+    };
+    const Correction& correction() const { return *correction_; };
+
+  private:
+    friend class Correction;
+    explicit BoundCorrection(const Correction& correction) : correction_(&correction) {};
+
+    const Correction * correction_;
+};
+
+namespace detail {
+  template<typename T>
+  constexpr Variable::VarType bound_type() {
+    static_assert(
+        std::is_same_v<T, double> || std::is_same_v<T, int64_t> || std::is_same_v<T, std::string_view>,
+        "Correction::bind argument types must be double, int64_t, or std::string_view"
+        );
+    if constexpr ( std::is_same_v<T, double> ) return Variable::VarType::real;
+    else if constexpr ( std::is_same_v<T, int64_t> ) return Variable::VarType::integer;
+    else return Variable::VarType::string;
+  }
+}
+
+template<typename... Ts>
+BoundCorrection<Ts...> Correction::bind() const {
+  constexpr std::array<Variable::VarType, sizeof...(Ts)> types {detail::bound_type<Ts>()...};
+  check_signature(types.data(), types.size());
+  return BoundCorrection<Ts...>(*this);
+}
 class CorrectionSet;
 
 class CompoundCorrection {
@@ -301,10 +844,35 @@ class CompoundCorrection {
     size_t input_index(const std::string_view name) const;
     const Variable& output() const { return output_; };
     double evaluate(const std::vector<Variable::Type>& values) const;
+    // as above, converting the inputs in the buffers of context
+    double evaluate(const std::vector<Variable::Type>& values, EvaluationContext& context) const;
+    // does not allocate, unless it throws
+    double evaluate(const InputValue * values, size_t size) const;
+    double evaluate(const InputValue * values, size_t size, EvaluationContext& context) const;
+#ifdef __cpp_lib_span
+    double evaluate(std::span<const InputValue> values) const { return evaluate(values.data(), values.size()); };
+#endif
+    // Evaluate size entries at once, one column per input, writing to out[0, size)
+    void evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out) const;
+    // as above, with the temporary buffers of the nodes taken from context
+    // rather than the heap
+    void evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out,
+        EvaluationContext& context) const;
+#ifdef __cpp_lib_span
+    void evaluate_batch(std::span<const InputColumn> columns, std::span<double> out) const {
+      evaluate_batch(columns.data(), columns.size(), out.size(), out.data());
+    };
+#endif
+    // As above, with the results rounded to single precision, one block at a time
+    void evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, float * out) const;
 
   private:
     enum class UpdateOp {Add, Multiply, Divide, Last};
 
+    // evaluate_batch, with the buffers of context if not null
+    void evaluate_columns(const InputColumn * columns, size_t ncolumns, size_t size, double * out,
+        EvaluationContext * context) const;
+
     std::string name_;
     std::string description_;
     std::vector<Variable> inputs_;
@@ -330,6 +898,11 @@ class CorrectionSet {
     Correction::Ref at(const std::string& key) const { return corrections_.at(key); };
     Correction::Ref operator[](const std::string& key) const { return at(key); };
     const auto& compound() const { return compoundcorrections_; };
+    // Evaluate several corrections over the same size entries, one block of
+    // entries at a time so that input columns shared between them stay in
+    // cache. columns[k] are the inputs of the correction names[k], and its
+    // results are written to out[k*size, (k+1)*size)
+    void evaluate_many(const std::vector<std::string>& names, const std::vector<std::vector<InputColumn>>& columns, size_t size, double * out) const;
 
   private:
     int schema_version_;
@@ -9,11 +9,17 @@
 #include <rapidjson/error/en.h>
 #include <optional>
 #include <algorithm>
-#include <deque>
+#include <limits>
+#include <unordered_set>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
 #include <stdexcept>
 #include <cmath>
 #include <cstdlib> // std::abort
+#include <cstring> // std::memcpy, std::memcmp
 #include <random>
+#include <bitset>
 #include "correction.h"
 #define XXH_INLINE_ALL 1
 #include "xxhash.h"
@@ -49,8 +55,9 @@ namespace {
     else if ( json.IsObject() && json.HasMember("nodetype") ) {
       auto obj = JSONObject(json.GetObject());
       auto type = obj.getRequired<std::string_view>("nodetype");
-      if ( type == "binning" ) { return Binning(obj, context); }
-      else if ( type == "multibinning" ) { return MultiBinning(obj, context); }
+      // the children are resolved first, so nested binnings fuse from the bottom up
+      if ( type == "binning" ) { return MultiBinning::fused(Binning(obj, context)); }
+      else if ( type == "multibinning" ) { return MultiBinning::fused(MultiBinning(obj, context)); }
       else if ( type == "category" ) { return Category(obj, context); }
       else if ( type == "formula" ) { return Formula(obj, context); }
       else if ( type == "formularef" ) { return FormulaRef(obj, context); }
@@ -70,59 +77,311 @@ namespace {
       return node.evaluate(values);
     }
 
-    const std::vector<Variable::Type>& values;
+    const detail::InputView& values;
   };
 
-  // Per-thread scratch storage for Transform::evaluate.
-  // Depth indexing keeps nested Transform evaluations re-entrant-safe.
-  class TransformScratch {
-  public:
-    explicit TransformScratch(const std::vector<Variable::Type>& values):
-      slot_(acquire_slot())
-    {
-      slot_ = values;
+  template <class Node, class = void>
+  struct has_batch_evaluate : std::false_type {};
+
+  template <class Node>
+  struct has_batch_evaluate<Node, std::void_t<decltype(
+      std::declval<const Node&>().evaluate(std::declval<const detail::BatchView&>(), std::declval<double*>())
+      )>> : std::true_type {};
+
+  struct node_evaluate_batch {
+    void operator() (double node) { std::fill(out, out + values.size(), node); }
+
+    template <class Node>
+    void operator() (const Node &node) {
+      if constexpr ( has_batch_evaluate<Node>::value ) {
+        node.evaluate(values, out);
+      }
+      else {
+        // nodes without a batch implementation are evaluated one entry at a time
+        detail::ScratchBuffer<InputValue> row(values.scratch(), values.ncolumns());
+        std::uninitialized_fill(row.begin(), row.end(), InputValue(0.));
+        const detail::InputView view(row.data());
+        for (size_t i=0; i < values.size(); ++i) {
+          values.gather(i, row.data());
+          out[i] = node.evaluate(view);
+        }
+      }
+    }
+
+    const detail::BatchView& values;
+    double * out;
+  };
+
+  // The entries rows[0, n) of a batch, copied to contiguous columns, for
+  // n up to capacity. The buffers are kept between calls to gather, to
+  // evaluate one group after another.
+  class GatheredBatch {
+    public:
+      GatheredBatch(const detail::BatchView& values, size_t capacity) :
+        values_(values),
+        capacity_(capacity),
+        columns_(values.scratch(), values.ncolumns()),
+        reals_(values.scratch(), capacity * count(values, Variable::VarType::real)),
+        integers_(values.scratch(), capacity * count(values, Variable::VarType::integer)),
+        strings_(values.scratch(), capacity * count(values, Variable::VarType::string))
+      {
+        std::uninitialized_copy(values.columns(), values.columns() + values.ncolumns(), columns_.begin());
+      }
+
+      detail::BatchView gather(const size_t * rows, size_t n) {
+        // the columns of each type are laid out one after another in their buffer
+        double * reals = reals_.data();
+        int64_t * integers = integers_.data();
+        std::string_view * strings = strings_.data();
+        for (size_t j=0; j < values_.ncolumns(); ++j) {
+          const auto& column = values_[j];
+          if ( column.broadcast() ) continue;
+          switch ( column.type() ) {
+            case Variable::VarType::real:
+              // single precision columns are widened here, as they are read
+              if ( column.single() ) gather(static_cast<const float*>(column.data()), rows, n, reals);
+              else gather(static_cast<const double*>(column.data()), rows, n, reals);
+              columns_[j] = InputColumn(reals);
+              reals += capacity_;
+              break;
+            case Variable::VarType::integer:
+              gather(static_cast<const int64_t*>(column.data()), rows, n, integers);
+              columns_[j] = InputColumn(integers);
+              integers += capacity_;
+              break;
+            default:
+              gather(static_cast<const std::string_view*>(column.data()), rows, n, strings);
+              columns_[j] = InputColumn(strings);
+              strings += capacity_;
+          }
+        }
+        return detail::BatchView(columns_.data(), columns_.size(), n, nullptr, values_.scratch());
+      }
+
+    private:
+      static size_t count(const detail::BatchView& values, Variable::VarType type) {
+        size_t out {0};
+        for (size_t j=0; j < values.ncolumns(); ++j) {
+          if ( ! values[j].broadcast() && values[j].type() == type ) ++out;
+        }
+        return out;
+      }
+
+      template<typename T, typename U>
+      static void gather(const T * data, const size_t * rows, size_t n, U * buffer) {
+        for (size_t i=0; i < n; ++i) buffer[i] = data[rows[i]];
+      }
+
+      const detail::BatchView& values_;
+      size_t capacity_;
+      // declared in the order they are taken from the scratch memory
+      detail::ScratchBuffer<InputColumn> columns_;
+      detail::ScratchBuffer<double> reals_;
+      detail::ScratchBuffer<int64_t> integers_;
+      detail::ScratchBuffer<std::string_view> strings_;
+  };
+
+  // find_bin_idx_nothrow result where find_bin_idx throws
+  constexpr size_t bin_failed = std::numeric_limits<size_t>::max();
+
+  // Batch evaluation does not raise for entries that cannot be evaluated:
+  // their result is a NaN with the status in its payload, which is copied up
+  // the tree as is, for Correction::evaluate_batch to raise or replace
+  constexpr uint64_t failed_bits = 0x7ffc5f0000000000ull;
+
+  double failed_value(Correction::EntryStatus status) {
+    const uint64_t bits = failed_bits | static_cast<uint64_t>(status);
+    double out;
+    std::memcpy(&out, &bits, sizeof(out));
+    return out;
+  }
+
+  Correction::EntryStatus entry_status(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if ( (bits & ~uint64_t{0xff}) != failed_bits ) return Correction::EntryStatus::ok;
+    return static_cast<Correction::EntryStatus>(bits & 0xff);
+  }
+
+  // replaces the failed entries of a batch by fill, and records the status of every entry if status is not null
+  void fill_failed(double * out, size_t size, double fill, Correction::EntryStatus * status) {
+    for (size_t i=0; i < size; ++i) {
+      const Correction::EntryStatus entry = entry_status(out[i]);
+      if ( entry != Correction::EntryStatus::ok ) out[i] = fill;
+      if ( status != nullptr ) status[i] = entry;
     }
+  }
 
-    ~TransformScratch() {
-      release_slot();
+  // the route of a failed entry, past the children of any node
+  constexpr size_t failed_route(Correction::EntryStatus status) { return bin_failed - static_cast<size_t>(status); }
+
+  Correction::EntryStatus route_status(size_t route) { return static_cast<Correction::EntryStatus>(bin_failed - route); }
+
+  // Evaluate a batch routed to the children of a node: the entry i goes to
+  // child(route[i]), with route[i] < nchildren. Entries are grouped by child,
+  // so that each child is evaluated once over all of its entries.
+  template<typename Child>
+  void evaluate_routed(const detail::BatchView& values, const size_t * route, size_t nchildren, Child&& child, double * out) {
+    const size_t size = values.size();
+    if ( size == 0 ) return;
+    // counting sort of the entries by child, first[k] is the start of the group of child k
+    detail::ScratchBuffer<size_t> first(values.scratch(), nchildren + 1);
+    std::fill(first.begin(), first.end(), 0);
+    size_t nfailed {0};
+    for (size_t i=0; i < size; ++i) {
+      if ( route[i] < nchildren ) ++first[route[i] + 1];
+      else {
+        out[i] = failed_value(route_status(route[i]));
+        ++nfailed;
+      }
+    }
+    size_t largest {0};
+    for (size_t k=0; k < nchildren; ++k) {
+      if ( first[k + 1] == size ) {
+        // all entries take the same branch: no need to gather
+        std::visit(node_evaluate_batch{values, out}, child(k));
+        return;
+      }
+      largest = std::max(largest, first[k + 1]);
+      first[k + 1] += first[k];
+    }
+    detail::ScratchBuffer<size_t> rows(values.scratch(), size - nfailed);
+    {
+      detail::ScratchBuffer<size_t> next(values.scratch(), nchildren);
+      std::copy(first.begin(), first.end() - 1, next.begin());
+      for (size_t i=0; i < size; ++i) {
+        if ( route[i] < nchildren ) rows[next[route[i]]++] = i;
+      }
     }
 
-    std::vector<Variable::Type>& values() {
-      return slot_;
+    GatheredBatch gathered(values, largest);
+    detail::ScratchBuffer<double> result(values.scratch(), largest);
+    for (size_t k=0; k < nchildren; ++k) {
+      const size_t * group = rows.data() + first[k];
+      const size_t n = first[k + 1] - first[k];
+      if ( n == 0 ) continue;
+      const Content& node = child(k);
+      if ( const auto* value = std::get_if<double>(&node) ) {
+        for (size_t i=0; i < n; ++i) out[group[i]] = *value;
+        continue;
+      }
+      std::visit(node_evaluate_batch{gathered.gather(group, n), result.data()}, node);
+      for (size_t i=0; i < n; ++i) out[group[i]] = result[i];
     }
+  }
+
+  struct node_specialize {
+    Content operator() (double node) { return node; }
 
-  private:
-    static std::vector<Variable::Type>& acquire_slot() {
-      if (depth_ == slots_.size()) {
-        slots_.emplace_back();
+    Content operator() (const Formula &node) {
+      Formula out = node.specialize(spec);
+      if ( out.ast().nodetype() == FormulaAst::NodeType::Literal ) {
+        return std::get<double>(out.ast().data());
       }
-      return slots_[depth_++];
+      if ( spec.tabulation ) return Tabulated::tabulate(std::move(out), spec);
+      return out;
     }
 
-    static void release_slot() {
-      depth_--;
+    Content operator() (const FormulaRef &node) {
+      Content out = node.specialize(spec);
+      if ( spec.tabulation ) return Tabulated::tabulate(std::move(out), spec);
+      return out;
     }
 
-    std::vector<Variable::Type>& slot_;
-    static thread_local std::deque<std::vector<Variable::Type>> slots_;
-    static thread_local std::size_t depth_;
+    Content operator() (const LWTNN &node) {
+      Content out = node.specialize(spec);
+      if ( spec.tabulation ) return Tabulated::tabulate(std::move(out), spec);
+      return out;
+    }
+
+    template <class Node>
+    Content operator() (const Node &node) {
+      return node.specialize(spec);
+    }
+
+    const detail::Specialization& spec;
   };
 
-  thread_local std::deque<std::vector<Variable::Type>> TransformScratch::slots_;
-  thread_local std::size_t TransformScratch::depth_ = 0;
+  // Specialize a child of a node that branches on a free input. Errors from
+  // resolving the fixed inputs (e.g. flow: error) only happen in some branches
+  // then, which cannot be represented in the specialized tree.
+  Content specialize_branch(const Content& node, const detail::Specialization& spec) {
+    try {
+      return std::visit(node_specialize{spec}, node);
+    }
+    catch (const std::out_of_range& ex) {
+      throw std::invalid_argument(std::string("Cannot specialize, the fixed inputs fail in only some branches: ") + ex.what());
+    }
+    catch (const std::runtime_error& ex) {
+      throw std::invalid_argument(std::string("Cannot specialize, the fixed inputs fail in only some branches: ") + ex.what());
+    }
+  }
+
+  // The range of the input of a binning within the bin binIdx, as seen by the
+  // child there: open on the flow side for clamp, unknown for the flow content
+  std::pair<double, double> bin_range(const detail::EdgesType& bins, detail::FlowBehavior flow, size_t binIdx) {
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    double low {0.}, high {0.};
+    size_t nbins;
+    if ( const auto *uniform = std::get_if<detail::UniformBins>(&bins) ) {
+      nbins = uniform->n;
+      low = uniform->low + (uniform->high - uniform->low) * binIdx / nbins;
+      high = uniform->low + (uniform->high - uniform->low) * (binIdx + 1) / nbins;
+    }
+    else {
+      const auto& edges = *std::get<detail::NonUniformBins>(bins);
+      nbins = edges.size() - 1;
+      if ( binIdx < nbins ) {
+        low = edges[binIdx];
+        high = edges[binIdx + 1];
+      }
+    }
+    if ( binIdx >= nbins || flow == detail::FlowBehavior::wrap ) return {-inf, inf};
+    if ( flow == detail::FlowBehavior::clamp ) {
+      if ( binIdx == 0 ) low = -inf;
+      if ( binIdx == nbins - 1 ) high = inf;
+    }
+    return {low, high};
+  }
+
+  // restrict the domain of an input for Correction::tabulated
+  void narrow(detail::Specialization& spec, size_t variableIdx, std::pair<double, double> range) {
+    auto& domain = spec.domain[variableIdx];
+    domain = {std::max(domain.first, range.first), std::min(domain.second, range.second)};
+  }
 
-  std::size_t find_bin_idx(Variable::Type value_variant,
-                           const detail::EdgesType &bins_,
-                           const detail::FlowBehavior &flow,
-                           std::size_t variableIdx,
-                           const char *name)
+  void collect_variables(const FormulaAst& ast, std::vector<size_t>& out) {
+    if ( ast.nodetype() == FormulaAst::NodeType::Variable ) out.push_back(std::get<size_t>(ast.data()));
+    for (const auto& child : ast.children()) collect_variables(child, out);
+  }
+
+  bool depends_on_variables(const FormulaAst& ast) {
+    if ( ast.nodetype() == FormulaAst::NodeType::Variable ) return true;
+    for (const auto& child : ast.children()) {
+      if ( depends_on_variables(child) ) return true;
+    }
+    return false;
+  }
+
+  uint64_t hashprng_seed_word(const InputValue& value) {
+    if ( value.type() == Variable::VarType::integer ) {
+      return static_cast<uint64_t>(value.integer());
+    }
+    else if ( value.type() == Variable::VarType::real ) {
+      const double v = value.real();
+      uint64_t bits;
+      std::memcpy(&bits, &v, sizeof(bits));
+      return bits;
+    }
+    throw std::logic_error("I should not have ever seen a string");
+  }
+
+  // as find_bin_idx, without the error: bin_failed for values out of range
+  // with flow error (or that wrap cannot handle, such as NaN)
+  std::size_t find_bin_idx_nothrow(double value,
+                                   const detail::EdgesType &bins_,
+                                   const detail::FlowBehavior &flow)
   {
-    double value = std::visit([](auto&& arg) -> double {
-      using T = std::decay_t<decltype(arg)>;
-      if constexpr (std::is_same_v<T, int64_t>) return static_cast<double>(arg);
-      else if constexpr (std::is_same_v<T, double>) return arg;
-      else throw std::logic_error("I should not have ever seen a string");
-      }, value_variant);
     if ( auto *bins = std::get_if<detail::UniformBins>(&bins_) ) { // uniform binning
       if (value < bins->low || value >= bins->high) {
         switch (flow) {
@@ -133,9 +392,7 @@ namespace {
           case detail::FlowBehavior::wrap:
             break;
           case detail::FlowBehavior::error:
-            const std::string belowOrAbove = value < bins->low ? "below" : "above";
-            auto msg = "Index " + belowOrAbove + " bounds in " + name + " for input argument " + std::to_string(variableIdx) + " value: " + std::to_string(value);
-            throw std::runtime_error(std::move(msg));
+            return bin_failed;
         }
       }
 
@@ -148,8 +405,7 @@ namespace {
     }
 
     // otherwise we have non-uniform binning
-    using namespace std::string_literals;
-    const auto& bins = std::get<detail::NonUniformBins>(bins_);
+    const auto& bins = *std::get<detail::NonUniformBins>(bins_);
     if ( flow == detail::FlowBehavior::wrap ) {
       double low = bins[0];
       double high = bins[bins.size() - 1];
@@ -163,29 +419,19 @@ namespace {
       if ( flow == detail::FlowBehavior::value ) {
         return bins.size() - 1; // the default value is stored at the end of the content array, after the last bin
       }
-      else if ( flow == detail::FlowBehavior::error ) {
-        throw std::runtime_error("Index below bounds in "s + name + " for input argument " + std::to_string(variableIdx) + " value: " + std::to_string(value));
-      }
-      else if ( flow == detail::FlowBehavior::wrap ) {
-        throw std::logic_error("I should not have ever seen an underflow");
-      }
-      else { // clamp
-        it++;
+      else if ( flow != detail::FlowBehavior::clamp ) { // error, or wrap which should not underflow
+        return bin_failed;
       }
+      it++;
     }
     else if ( it == std::end(bins) ) { // overflow
       if ( flow == detail::FlowBehavior::value ) {
         return bins.size() - 1;
       }
-      else if ( flow == detail::FlowBehavior::error ) {
-        throw std::runtime_error("Index above bounds in "s + name + " for input argument " + std::to_string(variableIdx) + " value: " + std::to_string(value));
-      }
-      else if ( flow == detail::FlowBehavior::wrap ) {
-        throw std::logic_error("I should not have ever seen an overflow");
-      }
-      else { // clamp
-        it--;
+      else if ( flow != detail::FlowBehavior::clamp ) { // error, or wrap which should not overflow
+        return bin_failed;
       }
+      it--;
     }
 
     // -1 because upper_bound returns the edge _after_ the bin we are interested in
@@ -193,6 +439,148 @@ namespace {
     return binIdx;
   }
 
+  std::size_t find_bin_idx(double value,
+                           const detail::EdgesType &bins_,
+                           const detail::FlowBehavior &flow,
+                           std::size_t variableIdx,
+                           const char *name)
+  {
+    const std::size_t binIdx = find_bin_idx_nothrow(value, bins_, flow);
+    if ( binIdx != bin_failed ) return binIdx;
+
+    using namespace std::string_literals;
+    const auto *uniform = std::get_if<detail::UniformBins>(&bins_);
+    const double low = uniform ? uniform->low : std::get<detail::NonUniformBins>(bins_)->front();
+    if ( flow == detail::FlowBehavior::wrap ) {
+      throw std::logic_error(value < low ? "I should not have ever seen an underflow" : "I should not have ever seen an overflow");
+    }
+    const std::string belowOrAbove = value < low ? "below" : "above";
+    throw std::runtime_error("Index "s + belowOrAbove + " bounds in " + name + " for input argument " + std::to_string(variableIdx) + " value: " + std::to_string(value));
+  }
+
+  // above this many edges, non-uniform MultiBinning axes use a binary search
+  constexpr size_t linear_search_edges = 8;
+  // entries per block of CorrectionSet::evaluate_many and of single precision outputs
+  constexpr size_t many_batch_block = 2048;
+
+  // evaluate(block, n, result) for each block of the columns, rounding
+  // the results to out, so that the double results are only a block long
+  template<typename F>
+  void evaluate_narrowed(const InputColumn * columns, size_t ncolumns, size_t size, float * out, F&& evaluate) {
+    std::vector<InputColumn> block(columns, columns + ncolumns);
+    std::vector<double> result(std::min(size, many_batch_block));
+    for (size_t start=0; start < size; start += many_batch_block) {
+      const size_t n = std::min(many_batch_block, size - start);
+      for (size_t j=0; j < ncolumns; ++j) block[j] = columns[j].offset(start);
+      evaluate(block.data(), n, result.data());
+      std::copy(result.begin(), result.begin() + n, out + start);
+    }
+  }
+
+  // Correction::evaluate_grid expands its trailing axes to at most this many
+  // entries, to reach many_batch_block entries per batch
+  constexpr size_t grid_max_block = 64 * many_batch_block;
+
+  // the values of a grid axis of n points for the entries of a block, in
+  // which each point repeats inner times, cycling
+  template<typename T, typename U = T>
+  const U * expand_axis(const T * data, size_t n, size_t inner, size_t size, std::vector<U>& out) {
+    out.resize(size);
+    for (size_t i=0; i < size; ++i) out[i] = data[(i / inner) % n];
+    return out.data();
+  }
+
+  detail::MultiBinningAxis make_axis(size_t variableIdx, size_t stride, detail::EdgesType bins) {
+    detail::MultiBinningAxis axis{variableIdx, stride, std::move(bins), 0, 0., 0., 0., 0., false};
+    if ( const auto *uniform = std::get_if<detail::UniformBins>(&axis.bins) ) {
+      axis.nbins = uniform->n;
+      axis.low = uniform->low;
+      axis.high = uniform->high;
+      axis.scale = uniform->n / (uniform->high - uniform->low);
+      // a generous bound on the difference between the two ways of computing the scaled value
+      axis.tolerance = 8 * std::numeric_limits<double>::epsilon() * uniform->n;
+    }
+    else {
+      const auto& edges = *std::get<detail::NonUniformBins>(axis.bins);
+      axis.nbins = edges.size() - 1;
+      axis.low = edges.front();
+      axis.high = edges.back();
+      axis.linear = edges.size() <= linear_search_edges;
+    }
+    return axis;
+  }
+
+  bool same_edges(const detail::EdgesType& a, const detail::EdgesType& b) {
+    if ( const auto* x = std::get_if<detail::UniformBins>(&a) ) {
+      const auto* y = std::get_if<detail::UniformBins>(&b);
+      return y != nullptr && x->n == y->n && x->low == y->low && x->high == y->high;
+    }
+    const auto* y = std::get_if<detail::NonUniformBins>(&b);
+    if ( y == nullptr ) return false;
+    const auto& x = std::get<detail::NonUniformBins>(a);
+    return x == *y || *x == **y;
+  }
+
+  // table nodes whose contents are all constants keep them as plain doubles
+  void pack_constants(std::vector<Content>& contents, std::vector<double>& values) {
+    for (const auto& item : contents) {
+      if ( ! std::holds_alternative<double>(item) ) return;
+    }
+    values.reserve(contents.size());
+    for (const auto& item : contents) values.push_back(std::get<double>(item));
+    contents.clear();
+    contents.shrink_to_fit();
+  }
+
+  // the same representation: -0. and 0. differ, a NaN equals itself
+  bool same_bits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+  }
+
+  // MultiBinning cells are stored sparse when at most this fraction of them
+  // differ from the most common constant, in tables of at least this many cells
+  constexpr double sparse_max_fill = 0.25;
+  constexpr size_t sparse_min_cells = 256;
+
+  // the constant that enough of the n cells hold for sparse storage, if any.
+  // constant(i) is the content of cell i if it is a constant
+  template<typename F>
+  std::optional<double> sparse_common(size_t n, F&& constant) {
+    if ( n < sparse_min_cells ) return std::nullopt;
+    auto same = [](const std::optional<double>& a, const std::optional<double>& b) {
+      return a ? ( b && same_bits(*a, *b) ) : ! b;
+    };
+    // a majority vote for the candidate, then a count
+    std::optional<double> candidate;
+    size_t votes {0};
+    for (size_t i=0; i < n; ++i) {
+      const auto value = constant(i);
+      if ( votes == 0 ) {
+        candidate = value;
+        votes = 1;
+      }
+      else if ( same(value, candidate) ) ++votes;
+      else --votes;
+    }
+    if ( ! candidate ) return std::nullopt;
+    size_t count {0};
+    for (size_t i=0; i < n; ++i) count += same(constant(i), candidate);
+    if ( count < (1. - sparse_max_fill) * n ) return std::nullopt;
+    return candidate;
+  }
+
+  // the mask of the given cells (sorted) of a sparse MultiBinning
+  std::vector<detail::SparseCells> sparse_cells(const std::vector<size_t>& cells, size_t ncells) {
+    std::vector<detail::SparseCells> out((ncells + 63) / 64, detail::SparseCells{0, 0});
+    for (size_t cell : cells) out[cell / 64].mask |= uint64_t{1} << (cell % 64);
+    size_t before {0};
+    for (auto& word : out) {
+      word.before = before;
+      before += std::bitset<64>(word.mask).count();
+    }
+    return out;
+  }
+
   double parse_edge(const rapidjson::Value& edge) {
     if ( edge.IsDouble() ) {
       return edge.GetDouble();
@@ -216,6 +604,91 @@ namespace {
     }
     return result;
   }
+
+  // Category lookup tables
+  constexpr uint32_t empty_slot = std::numeric_limits<uint32_t>::max();
+  constexpr uint64_t fibonacci_multiplier = 0x9e3779b97f4a7c15ull;
+
+  size_t hash_table_size(size_t nkeys) {
+    // at most half full, so probe sequences stay short
+    size_t size = 2;
+    while ( size < 2 * nkeys ) size *= 2;
+    return size;
+  }
+
+  detail::CategoryTable build_category_table(const std::vector<int64_t>& keys) {
+    if ( keys.size() >= empty_slot ) {
+      throw std::runtime_error("Too many keys in Category");
+    }
+    if ( keys.empty() ) {
+      return detail::DenseIntTable{0, {}};
+    }
+    const auto [min, max] = std::minmax_element(keys.begin(), keys.end());
+    const uint64_t span = static_cast<uint64_t>(*max) - static_cast<uint64_t>(*min) + 1;
+    // a direct-index array if it is not mostly empty, e.g. flavour (0, 4, 5) or years
+    if ( span != 0 && span <= std::max<uint64_t>(64, 4 * keys.size()) ) {
+      detail::DenseIntTable table{*min, std::vector<uint32_t>(span, keys.size())};
+      for (size_t i=0; i < keys.size(); ++i) {
+        table.slots[static_cast<uint64_t>(keys[i]) - static_cast<uint64_t>(*min)] = i;
+      }
+      return table;
+    }
+    detail::IntHashTable table;
+    const size_t size = hash_table_size(keys.size());
+    table.shift = 64;
+    for (size_t s = size; s > 1; s /= 2) table.shift--;
+    table.keys.resize(size);
+    table.slots.resize(size, empty_slot);
+    for (size_t i=0; i < keys.size(); ++i) {
+      size_t pos = (static_cast<uint64_t>(keys[i]) * fibonacci_multiplier) >> table.shift;
+      while ( table.slots[pos] != empty_slot ) pos = (pos + 1) & (size - 1);
+      table.keys[pos] = keys[i];
+      table.slots[pos] = i;
+    }
+    return table;
+  }
+
+  detail::CategoryTable build_category_table(const std::vector<std::string>& keys) {
+    if ( keys.size() >= empty_slot ) {
+      throw std::runtime_error("Too many keys in Category");
+    }
+    detail::StrHashTable table;
+    const size_t size = hash_table_size(keys.size());
+    table.mask = size - 1;
+    table.hashes.resize(size);
+    table.keys.resize(size);
+    table.slots.resize(size, empty_slot);
+    for (size_t i=0; i < keys.size(); ++i) {
+      const uint64_t hash = XXH3_64bits(keys[i].data(), keys[i].size());
+      size_t pos = hash & table.mask;
+      while ( table.slots[pos] != empty_slot ) pos = (pos + 1) & table.mask;
+      table.hashes[pos] = hash;
+      table.keys[pos] = keys[i];
+      table.slots[pos] = i;
+    }
+    return table;
+  }
+
+  // tables are built deterministically from the keys in order
+  bool same_table(const detail::CategoryTable& a, const detail::CategoryTable& b) {
+    if ( a.index() != b.index() ) return false;
+    if ( const auto* x = std::get_if<detail::DenseIntTable>(&a) ) {
+      const auto& y = std::get<detail::DenseIntTable>(b);
+      return x->offset == y.offset && x->slots == y.slots;
+    }
+    if ( const auto* x = std::get_if<detail::IntHashTable>(&a) ) {
+      const auto& y = std::get<detail::IntHashTable>(b);
+      return x->shift == y.shift && x->keys == y.keys && x->slots == y.slots;
+    }
+    const auto& x = std::get<detail::StrHashTable>(a);
+    const auto& y = std::get<detail::StrHashTable>(b);
+    return x.mask == y.mask && x.keys == y.keys && x.slots == y.slots;
+  }
+
+  // the string alternatives are viewed in place
+  std::vector<InputValue> input_values(const std::vector<Variable::Type>& values) {
+    return std::vector<InputValue>(values.begin(), values.end());
+  }
 } // end of anonymous namespace
 
 Variable::Variable(const JSONObject& json) :
@@ -238,19 +711,42 @@ std::string Variable::typeStr() const {
 
 void Variable::validate(const Type& t) const {
   if ( std::holds_alternative<std::string>(t) ) {
-    if ( type_ != VarType::string ) {
-      throw std::runtime_error("Input " + name() + " has wrong type: got string expected " + typeStr());
-    }
+    validate(VarType::string);
   }
   else if ( std::holds_alternative<int64_t>(t) ) {
-    if ( type_ != VarType::integer ) {
-      throw std::runtime_error("Input " + name() + " has wrong type: got int expected " + typeStr());
-    }
+    validate(VarType::integer);
   }
   else if ( std::holds_alternative<double>(t) ) {
-    if ( type_ != VarType::real ) {
-      throw std::runtime_error("Input " + name() + " has wrong type: got real-valued expected " + typeStr());
-    }
+    validate(VarType::real);
+  }
+}
+
+void Variable::validate(VarType t) const {
+  if ( t == type_ ) return;
+  if ( t == VarType::string ) {
+    throw std::runtime_error("Input " + name() + " has wrong type: got string expected " + typeStr());
+  }
+  else if ( t == VarType::integer ) {
+    throw std::runtime_error("Input " + name() + " has wrong type: got int expected " + typeStr());
+  }
+  else {
+    throw std::runtime_error("Input " + name() + " has wrong type: got real-valued expected " + typeStr());
+  }
+}
+
+InputValue::InputValue(const Variable::Type& value) {
+  if ( auto v = std::get_if<int64_t>(&value) ) {
+    type_ = Variable::VarType::integer;
+    integer_ = *v;
+  }
+  else if ( auto v = std::get_if<double>(&value) ) {
+    type_ = Variable::VarType::real;
+    real_ = *v;
+  }
+  else {
+    const auto& str = std::get<std::string>(value);
+    type_ = Variable::VarType::string;
+    string_ = {str.data(), str.size()};
   }
 }
 
@@ -316,27 +812,73 @@ Formula::Ref Formula::from_string(const char * data, std::vector<Variable>& inpu
 }
 
 double Formula::evaluate(const std::vector<Variable::Type>& values) const {
+  const auto inputs = input_values(values);
+  return evaluate(detail::InputView(inputs.data()));
+}
+
+double Formula::evaluate(const std::vector<Variable::Type>& values, const std::vector<double>& params) const {
+  const auto inputs = input_values(values);
+  return evaluate(detail::InputView(inputs.data()), params);
+}
+
+double Formula::evaluate(const detail::InputView& values) const {
   if ( generic_ ) {
     throw std::runtime_error("Generic formulas must be evaluated with parameters");
   }
   return ast_->evaluate(values, {});
 }
 
-double Formula::evaluate(const std::vector<Variable::Type>& values, const std::vector<double>& params) const {
+double Formula::evaluate(const detail::InputView& values, const std::vector<double>& params) const {
   return ast_->evaluate(values, params);
 }
 
+void Formula::evaluate(const detail::BatchView& values, double * out) const {
+  if ( generic_ ) {
+    throw std::runtime_error("Generic formulas must be evaluated with parameters");
+  }
+  ast_->evaluate(values, {}, out);
+}
+
+void Formula::evaluate(const detail::BatchView& values, const std::vector<double>& params, double * out) const {
+  ast_->evaluate(values, params, out);
+}
+
+Formula Formula::specialize(const detail::Specialization& spec) const {
+  Formula out;
+  out.expression_ = expression_;
+  out.type_ = type_;
+  out.ast_ = std::make_unique<FormulaAst>(ast_->specialize(spec));
+  out.generic_ = generic_;
+  return out;
+}
+
 FormulaRef::FormulaRef(const JSONObject& json, const Correction& context) {
-  formula_ = context.formula_ref(json.getRequired<int>("index"));
+  index_ = json.getRequired<int>("index");
+  formula_ = context.formula_ref(index_);
   for (const auto& item : json.getRequired<rapidjson::Value::ConstArray>("parameters")) {
     parameters_.push_back(item.GetDouble());
   }
 }
 
-double FormulaRef::evaluate(const std::vector<Variable::Type>& values) const {
+double FormulaRef::evaluate(const detail::InputView& values) const {
   return formula_->evaluate(values, parameters_);
 }
 
+void FormulaRef::evaluate(const detail::BatchView& values, double * out) const {
+  formula_->evaluate(values, parameters_, out);
+}
+
+Content FormulaRef::specialize(const detail::Specialization& spec) const {
+  FormulaRef out;
+  out.index_ = index_;
+  out.formula_ = spec.target.formula_ref(index_);
+  out.parameters_ = parameters_;
+  if ( ! depends_on_variables(out.formula_->ast()) ) {
+    return out.evaluate(detail::InputView(nullptr));
+  }
+  return out;
+}
+
 Transform::Transform(const JSONObject& json, const Correction& context) {
   variableIdx_ = detail::find_input_index(json.getRequired<std::string_view>("input"), context.inputs());
   const auto& variable = context.inputs()[variableIdx_];
@@ -347,22 +889,97 @@ Transform::Transform(const JSONObject& json, const Correction& context) {
   content_ = std::make_unique<Content>(resolve_content(json.getRequiredValue("content"), context));
 }
 
-double Transform::evaluate(const std::vector<Variable::Type>& values) const {
-  TransformScratch scratch(values);
-  auto& new_values = scratch.values();
+double Transform::evaluate(const detail::InputView& values) const {
+  const double vnew = std::visit(node_evaluate{values}, *rule_);
+  const InputValue& v = values[variableIdx_];
+  if ( v.type() == Variable::VarType::real ) {
+    return std::visit(node_evaluate{detail::InputView(values, variableIdx_, vnew)}, *content_);
+  }
+  else if ( v.type() == Variable::VarType::integer ) {
+    return std::visit(node_evaluate{detail::InputView(values, variableIdx_, (int64_t) std::round(vnew))}, *content_);
+  }
+  throw std::logic_error("I should not have ever seen a string");
+}
+
+void Transform::evaluate(const detail::BatchView& values, double * out) const {
+  // the rule is evaluated for the whole batch, and its column replaces the input
+  const auto evaluate_content = [this](const detail::BatchView& view, const double * vnew, double * result) {
+    const Variable::VarType type = view[variableIdx_].type();
+    detail::ScratchBuffer<int64_t> vnew_int(view.scratch(), ( type == Variable::VarType::integer ) ? view.size() : 0);
+    detail::ScratchBuffer<InputColumn> columns(view.scratch(), view.ncolumns());
+    std::uninitialized_copy(view.columns(), view.columns() + view.ncolumns(), columns.begin());
+    if ( type == Variable::VarType::real ) {
+      columns[variableIdx_] = InputColumn(vnew);
+    }
+    else if ( type == Variable::VarType::integer ) {
+      std::transform(vnew, vnew + view.size(), vnew_int.begin(), [](double v) { return (int64_t) std::round(v); });
+      columns[variableIdx_] = InputColumn(vnew_int.data());
+    }
+    else {
+      throw std::logic_error("I should not have ever seen a string");
+    }
+    const detail::BatchView transformed(columns.data(), view.ncolumns(), view.size(), nullptr, view.scratch());
+    std::visit(node_evaluate_batch{transformed, result}, *content_);
+  };
+
+  detail::ScratchBuffer<double> vnew(values.scratch(), values.size());
+  std::visit(node_evaluate_batch{values, vnew.data()}, *rule_);
+  // the entries where the rule failed keep its status, the others go on to the content
+  size_t nfailed {0};
+  for (size_t i=0; i < values.size(); ++i) {
+    if ( entry_status(vnew[i]) != Correction::EntryStatus::ok ) {
+      out[i] = vnew[i];
+      ++nfailed;
+    }
+  }
+  if ( nfailed == 0 ) {
+    evaluate_content(values, vnew.data(), out);
+    return;
+  }
+  const size_t n = values.size() - nfailed;
+  if ( n == 0 ) return;
+  detail::ScratchBuffer<size_t> rows(values.scratch(), n);
+  for (size_t i=0, j=0; i < values.size(); ++i) {
+    if ( entry_status(vnew[i]) != Correction::EntryStatus::ok ) continue;
+    rows[j] = i;
+    vnew[j++] = vnew[i];
+  }
+  GatheredBatch gathered(values, n);
+  detail::ScratchBuffer<double> result(values.scratch(), n);
+  evaluate_content(gathered.gather(rows.data(), n), vnew.data(), result.data());
+  for (size_t j=0; j < n; ++j) out[rows[j]] = result[j];
+}
 
-  double vnew = std::visit(node_evaluate{values}, *rule_);
-  auto& v = new_values[variableIdx_];
-  if ( std::holds_alternative<double>(v) ) {
-    v = vnew;
+Content Transform::specialize(const detail::Specialization& spec) const {
+  Content rule = std::visit(node_specialize{spec}, *rule_);
+  if ( const double* vnew = std::get_if<double>(&rule) ) {
+    // the rewritten value is known, so the transform disappears
+    detail::Specialization inner(spec);
+    if ( spec.source.inputs()[variableIdx_].type() == Variable::VarType::integer ) {
+      inner.values[variableIdx_] = (int64_t) std::round(*vnew);
+    }
+    else {
+      inner.values[variableIdx_] = *vnew;
+    }
+    return std::visit(node_specialize{inner}, *content_);
+  }
+  if ( spec.fixed(variableIdx_) ) {
+    throw std::invalid_argument("Cannot specialize input " + spec.source.inputs()[variableIdx_].name()
+        + ": it is rewritten by a Transform whose rule depends on other inputs");
   }
-  else if ( std::holds_alternative<int64_t>(v) ) {
-    v = (int64_t) std::round(vnew);
+  Transform out;
+  out.variableIdx_ = spec.remap[variableIdx_];
+  out.rule_ = std::make_unique<Content>(std::move(rule));
+  if ( spec.tabulation ) {
+    // the rewritten input can take any value
+    detail::Specialization inner(spec);
+    inner.domain[variableIdx_] = {-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+    out.content_ = std::make_unique<Content>(std::visit(node_specialize{inner}, *content_));
   }
   else {
-    throw std::logic_error("I should not have ever seen a string");
+    out.content_ = std::make_unique<Content>(std::visit(node_specialize{spec}, *content_));
   }
-  return std::visit(node_evaluate{new_values}, *content_);
+  return out;
 }
 
 HashPRNG::HashPRNG(const JSONObject& json, const Correction& context)
@@ -385,20 +1002,51 @@ HashPRNG::HashPRNG(const JSONObject& json, const Correction& context)
 
 }
 
-double HashPRNG::evaluate(const std::vector<Variable::Type>& values) const {
-  pcg32_oneseq gen;
+double HashPRNG::evaluate(const detail::InputView& values) const {
   size_t nbytes = sizeof(uint64_t)*variablesIdx_.size();
   uint64_t* seedData = (uint64_t*) alloca(nbytes);
   for(size_t i=0; i<variablesIdx_.size(); ++i) {
-    if ( auto v = std::get_if<int64_t>(&values[variablesIdx_[i]]) ) {
-      seedData[i] = static_cast<uint64_t>(*v);
+    if ( variablesIdx_[i] == fixed_input ) {
+      seedData[i] = fixedSeeds_[i];
+    }
+    else {
+      seedData[i] = hashprng_seed_word(values[variablesIdx_[i]]);
+    }
+  }
+  return generate(XXH64((const void*) seedData, nbytes, 0ul));
+}
+
+void HashPRNG::evaluate(const detail::BatchView& values, double * out) const {
+  // The seed words of all entries, one row per entry, filled one input at a time.
+  // The hash and generator are the same as for a single entry, so that every
+  // entry gets the same number as it would alone.
+  const size_t nwords = variablesIdx_.size();
+  const size_t size = values.size();
+  std::vector<uint64_t> seedData(size * nwords);
+  for(size_t k=0; k<nwords; ++k) {
+    uint64_t * words = seedData.data() + k;
+    if ( variablesIdx_[k] == fixed_input ) {
+      for(size_t i=0; i<size; ++i) words[i*nwords] = fixedSeeds_[k];
+      continue;
+    }
+    const InputColumn& column = values[variablesIdx_[k]];
+    if ( column.broadcast() ) {
+      const uint64_t word = hashprng_seed_word(column[0]);
+      for(size_t i=0; i<size; ++i) words[i*nwords] = word;
     }
-    else if ( auto v = std::get_if<double>(&values[variablesIdx_[i]]) ) {
-      seedData[i] = *reinterpret_cast<const uint64_t*>(v);
+    else {
+      for(size_t i=0; i<size; ++i) words[i*nwords] = hashprng_seed_word(column[i]);
     }
-    else { throw std::logic_error("I should not have ever seen a string"); }
   }
-  gen.seed(XXH64((const void*) seedData, nbytes, 0ul));
+  const size_t nbytes = sizeof(uint64_t)*nwords;
+  for(size_t i=0; i<size; ++i) {
+    out[i] = generate(XXH64((const void*) (seedData.data() + i*nwords), nbytes, 0ul));
+  }
+}
+
+double HashPRNG::generate(uint64_t seed) const {
+  pcg32_oneseq gen;
+  gen.seed(seed);
   switch (dist_) {
     case Distribution::stdflat:
       return std::uniform_real_distribution<>()(gen);
@@ -419,6 +1067,144 @@ double HashPRNG::evaluate(const std::vector<Variable::Type>& values) const {
   };
 }
 
+Content HashPRNG::specialize(const detail::Specialization& spec) const {
+  // the seed is unchanged, so the specialized generator gives the same numbers
+  HashPRNG out;
+  out.dist_ = dist_;
+  out.variablesIdx_.reserve(variablesIdx_.size());
+  out.fixedSeeds_.resize(variablesIdx_.size());
+  for(size_t i=0; i<variablesIdx_.size(); ++i) {
+    const size_t idx = variablesIdx_[i];
+    if ( idx == fixed_input ) {
+      out.variablesIdx_.push_back(fixed_input);
+      out.fixedSeeds_[i] = fixedSeeds_[i];
+    }
+    else if ( spec.fixed(idx) ) {
+      out.variablesIdx_.push_back(fixed_input);
+      out.fixedSeeds_[i] = hashprng_seed_word(spec.value(idx));
+    }
+    else {
+      out.variablesIdx_.push_back(spec.remap[idx]);
+    }
+  }
+  return out;
+}
+
+namespace correction::detail {
+  // Bin indices of input columns on non-uniform edges, for one block of
+  // CorrectionSet::evaluate_many: corrections binning the same input on the
+  // same (shared) edges search them once per entry
+  class BinIndexCache {
+    public:
+      static constexpr size_t outside = static_cast<size_t>(-1);
+
+      // the bin index of each entry of the input variableIdx of values, or
+      // outside for values out of the edges, which take the flow path. Null
+      // if not available for this binning
+      static const size_t * find(const BatchView& values, const EdgesType& bins, FlowBehavior flow, size_t variableIdx) {
+        const auto * edges = std::get_if<NonUniformBins>(&bins);
+        const auto& column = values[variableIdx];
+        if ( values.bin_indices() == nullptr || edges == nullptr || flow == FlowBehavior::wrap
+            || column.broadcast() || column.type() != Variable::VarType::real || column.single() ) {
+          return nullptr;
+        }
+        return values.bin_indices()->indices(**edges, static_cast<const double*>(column.data()), values.size());
+      }
+
+      void clear() { used_ = 0; }
+
+    private:
+      const size_t * indices(const std::vector<double>& edges, const double * data, size_t size) {
+        for (size_t j=0; j < used_; ++j) {
+          if ( entries_[j].edges == &edges && entries_[j].data == data ) return entries_[j].indices.data();
+        }
+        if ( used_ == entries_.size() ) entries_.emplace_back();
+        auto& entry = entries_[used_++];
+        entry.edges = &edges;
+        entry.data = data;
+        entry.indices.resize(size);
+        for (size_t i=0; i < size; ++i) {
+          const double value = data[i];
+          entry.indices[i] = ( value >= edges.front() && value < edges.back() )
+            ? std::upper_bound(edges.begin() + 1, edges.end() - 1, value) - edges.begin() - 1
+            : outside;
+        }
+        return entry.indices.data();
+      }
+
+      struct Entry {
+        const std::vector<double> * edges;
+        const double * data;
+        std::vector<size_t> indices;
+      };
+      std::vector<Entry> entries_; // the first used_ are valid, the others keep their buffers
+      size_t used_ = 0;
+  };
+}
+
+namespace correction::detail {
+  // Structural equality of subtrees, for Correction::coalesced: equal
+  // subtrees evaluate the same for all inputs. Constants compare by
+  // representation. Nodes of the other types are never considered equal.
+  struct SameContent {
+    bool operator()(const Content& a, const Content& b) const {
+      if ( a.index() != b.index() ) return false;
+      return std::visit([&](const auto& x) { return same(x, std::get<std::decay_t<decltype(x)>>(b)); }, a);
+    }
+
+    template<typename Node>
+    bool same(const Node&, const Node&) const { return false; }
+    bool same(double a, double b) const { return same_bits(a, b); }
+    bool same(const FormulaAst& a, const FormulaAst& b) const {
+      if ( a.nodetype() != b.nodetype() || a.data().index() != b.data().index() ) return false;
+      if ( const auto* x = std::get_if<double>(&a.data()) ) {
+        if ( ! same_bits(*x, std::get<double>(b.data())) ) return false;
+      }
+      else if ( a.data() != b.data() ) return false;
+      return same_all(a.children(), b.children());
+    }
+    bool same(const Formula& a, const Formula& b) const { return same(a.ast(), b.ast()); }
+    bool same(const FormulaRef& a, const FormulaRef& b) const {
+      return a.formula_ == b.formula_ && same_all(a.parameters_, b.parameters_);
+    }
+    bool same(const Transform& a, const Transform& b) const {
+      return a.variableIdx_ == b.variableIdx_ && (*this)(*a.rule_, *b.rule_) && (*this)(*a.content_, *b.content_);
+    }
+    bool same(const Binning& a, const Binning& b) const {
+      return a.variableIdx_ == b.variableIdx_ && a.flow_ == b.flow_ && same_edges(a.bins_, b.bins_)
+        && same_all(a.values_, b.values_) && same_all(a.contents_, b.contents_);
+    }
+    bool same(const MultiBinning& a, const MultiBinning& b) const {
+      if ( a.flow_ != b.flow_ || a.axes_.size() != b.axes_.size() || a.values_.empty() != b.values_.empty() ) return false;
+      for (size_t d=0; d < a.axes_.size(); ++d) {
+        if ( a.axes_[d].variableIdx != b.axes_[d].variableIdx || ! same_edges(a.axes_[d].bins, b.axes_[d].bins) ) return false;
+      }
+      // cell by cell, as either may be sparse
+      for (size_t c=0; c < a.ncells(); ++c) {
+        const size_t x = a.slot(c);
+        const size_t y = b.slot(c);
+        if ( a.values_.empty() ? ! (*this)(a.content_[x], b.content_[y]) : ! same_bits(a.values_[x], b.values_[y]) ) return false;
+      }
+      return true;
+    }
+    bool same(const Category& a, const Category& b) const {
+      if ( a.variableIdx_ != b.variableIdx_ || bool(a.default_) != bool(b.default_) || ! same_table(a.table_, b.table_) ) return false;
+      if ( a.default_ && ! (*this)(*a.default_, *b.default_) ) return false;
+      return same_all(a.content_, b.content_);
+    }
+
+    template<typename T>
+    bool same_all(const std::vector<T>& a, const std::vector<T>& b) const {
+      if ( a.size() != b.size() ) return false;
+      for (size_t i=0; i < a.size(); ++i) {
+        if ( ! same(a[i], b[i]) ) return false;
+      }
+      return true;
+    }
+    bool same(const Content& a, const Content& b) const { return (*this)(a, b); }
+  };
+}
+
 Binning::Binning(const JSONObject& json, const Correction& context)
 {
   const auto& content = json.getRequired<rapidjson::Value::ConstArray>("content");
@@ -430,8 +1216,7 @@ Binning::Binning(const JSONObject& json, const Correction& context)
     if ( edges.size() != content.Size() + 1 ) {
       throw std::runtime_error("Inconsistency in Binning: number of content nodes does not match binning");
     }
-    detail::NonUniformBins bins{std::move(edges)};
-    bins_ = std::move(bins);
+    bins_ = context.edges(std::move(edges));
   } else if ( edgesObj.IsObject() ) { // UniformBinning
     const JSONObject uniformBins{edgesObj.GetObject()};
     const auto n = uniformBins.getRequired<uint32_t>("n");
@@ -463,32 +1248,134 @@ Binning::Binning(const JSONObject& json, const Correction& context)
   for (size_t i=0; i < content.Size(); ++i)
     contents_.push_back(resolve_content(content[i], context));
   contents_.push_back(std::move(default_value));
+  pack_constants(contents_, values_);
 }
 
-double Binning::evaluate(const std::vector<Variable::Type>& values) const
+double Binning::evaluate(const detail::InputView& values) const
 {
-  std::size_t binIdx = find_bin_idx(values[variableIdx_], bins_, flow_, variableIdx_, "Binning");
+  std::size_t binIdx = find_bin_idx(values[variableIdx_].number(), bins_, flow_, variableIdx_, "Binning");
+  if ( ! values_.empty() ) return values_[binIdx];
   const Content& child = contents_[binIdx];
   return std::visit(node_evaluate{values}, child);
 }
 
-MultiBinning::MultiBinning(const JSONObject& json, const Correction& context)
+void Binning::route(const detail::BatchView& values, size_t * out) const
 {
-  const auto& inputs = json.getRequired<rapidjson::Value::ConstArray>("inputs");
+  const auto& column = values[variableIdx_];
+  if ( column.broadcast() ) {
+    // the same bin for all entries
+    const size_t binIdx = find_bin_idx_nothrow(column[0].number(), bins_, flow_);
+    std::fill(out, out + values.size(), ( binIdx == bin_failed ) ? failed_route(Correction::EntryStatus::out_of_range) : binIdx);
+    return;
+  }
+  const size_t * cached = detail::BinIndexCache::find(values, bins_, flow_, variableIdx_);
+  for (size_t i=0; i < values.size(); ++i) {
+    if ( cached != nullptr && cached[i] != detail::BinIndexCache::outside ) {
+      out[i] = cached[i];
+      continue;
+    }
+    const size_t binIdx = find_bin_idx_nothrow(column[i].number(), bins_, flow_);
+    out[i] = ( binIdx == bin_failed ) ? failed_route(Correction::EntryStatus::out_of_range) : binIdx;
+  }
+}
 
-  const auto& edges = json.getRequired<rapidjson::Value::ConstArray>("edges");
-  axes_.reserve(edges.Size());
-  size_t idx {0};
-  for (const auto& dimension : edges) {
-    const auto& input = inputs[idx];
-    if ( dimension.IsArray() ) { // non-uniform binning
-      std::vector<double> dim_edges = parse_bin_edges(dimension.GetArray());
-      if ( ! input.IsString() ) { throw std::runtime_error("invalid multibinning input type"); }
+void Binning::evaluate(const detail::BatchView& values, double * out) const
+{
+  detail::ScratchBuffer<size_t> route(values.scratch(), values.size());
+  this->route(values, route.data());
+  if ( ! values_.empty() ) {
+    for (size_t i=0; i < values.size(); ++i) {
+      out[i] = ( route[i] < values_.size() ) ? values_[route[i]] : failed_value(route_status(route[i]));
+    }
+    return;
+  }
+  evaluate_routed(values, route.data(), contents_.size(), [this](size_t k) -> const Content& { return contents_[k]; }, out);
+}
+
+Content Binning::specialize(const detail::Specialization& spec) const
+{
+  if ( spec.fixed(variableIdx_) ) {
+    std::size_t binIdx = find_bin_idx(InputValue(spec.value(variableIdx_)).number(), bins_, flow_, variableIdx_, "Binning");
+    if ( ! values_.empty() ) return values_[binIdx];
+    return std::visit(node_specialize{spec}, contents_[binIdx]);
+  }
+  Binning out;
+  out.bins_ = bins_;
+  out.variableIdx_ = spec.remap[variableIdx_];
+  out.flow_ = flow_;
+  out.values_ = values_;
+  out.contents_.reserve(contents_.size());
+  for (size_t k=0; k < contents_.size(); ++k) {
+    if ( spec.tabulation ) {
+      detail::Specialization inner(spec);
+      narrow(inner, variableIdx_, bin_range(bins_, flow_, k));
+      out.contents_.push_back(specialize_branch(contents_[k], inner));
+    }
+    else {
+      out.contents_.push_back(specialize_branch(contents_[k], spec));
+    }
+  }
+  // fixing inputs may have reduced all children to constants
+  pack_constants(out.contents_, out.values_);
+  if ( spec.coalesced ) out.coalesce(spec.target, *spec.coalesced);
+  return out;
+}
+
+void Binning::coalesce(const Correction& context, size_t& removed)
+{
+  // only inner edges go: the range, and with it the flow behavior, stays.
+  // Uniform bins would need edges that reproduce their arithmetic exactly
+  const auto* bins = std::get_if<detail::NonUniformBins>(&bins_);
+  if ( bins == nullptr ) return;
+  const auto& edges = **bins;
+  const size_t nbins = edges.size() - 1;
+  const bool constants = ! values_.empty();
+  std::vector<size_t> first{0}; // the first bin of each run of equal bins
+  for (size_t k=1; k < nbins; ++k) {
+    const bool same = constants ? same_bits(values_[first.back()], values_[k])
+      : detail::SameContent{}(contents_[first.back()], contents_[k]);
+    if ( ! same ) first.push_back(k);
+  }
+  if ( first.size() == nbins ) return;
+  removed += nbins - first.size();
+
+  std::vector<double> merged;
+  merged.reserve(first.size() + 1);
+  for (size_t j=0; j < first.size(); ++j) {
+    merged.push_back(edges[first[j]]);
+    // the default value, last, moves along
+    if ( constants ) values_[j] = values_[first[j]];
+    else if ( j != first[j] ) contents_[j] = std::move(contents_[first[j]]);
+  }
+  merged.push_back(edges.back());
+  if ( constants ) {
+    values_[first.size()] = values_.back();
+    values_.resize(first.size() + 1);
+  }
+  else {
+    contents_[first.size()] = std::move(contents_.back());
+    contents_.erase(contents_.begin() + first.size() + 1, contents_.end());
+  }
+  bins_ = context.edges(std::move(merged));
+}
+
+MultiBinning::MultiBinning(const JSONObject& json, const Correction& context)
+{
+  const auto& inputs = json.getRequired<rapidjson::Value::ConstArray>("inputs");
+
+  const auto& edges = json.getRequired<rapidjson::Value::ConstArray>("edges");
+  axes_.reserve(edges.Size());
+  size_t idx {0};
+  for (const auto& dimension : edges) {
+    const auto& input = inputs[idx];
+    if ( dimension.IsArray() ) { // non-uniform binning
+      std::vector<double> dim_edges = parse_bin_edges(dimension.GetArray());
+      if ( ! input.IsString() ) { throw std::runtime_error("invalid multibinning input type"); }
       size_t variableIdx = detail::find_input_index(input.GetString(), context.inputs());
       if ( context.inputs().at(variableIdx).type() == Variable::VarType::string ) {
         throw std::runtime_error("MultiBinning cannot use string inputs as binning variables");
       }
-      axes_.push_back({variableIdx, 0, detail::NonUniformBins(std::move(dim_edges))});
+      axes_.push_back(make_axis(variableIdx, 0, context.edges(std::move(dim_edges))));
     } else if ( dimension.IsObject() ) { // UniformBinning
       const JSONObject uniformBins{dimension.GetObject()};
       const auto n = uniformBins.getRequired<uint32_t>("n");
@@ -502,7 +1389,7 @@ MultiBinning::MultiBinning(const JSONObject& json, const Correction& context)
       if ( context.inputs().at(variableIdx).type() == Variable::VarType::string ) {
         throw std::runtime_error("MultiBinning cannot use string inputs as binning variables");
       }
-      axes_.push_back({variableIdx, 0, detail::UniformBins{n, low, high}});
+      axes_.push_back(make_axis(variableIdx, 0, detail::UniformBins{n, low, high}));
     } else {
       auto msg = "Error when processing MultiBinning: edges for dimension " + std::to_string(idx) + " are neither an array nor a UniformBinning object";
       throw std::runtime_error (std::move(msg));
@@ -518,56 +1405,415 @@ MultiBinning::MultiBinning(const JSONObject& json, const Correction& context)
     stride *= nbins(idx);
     --idx;
   }
-  content_.reserve(content.Size() + 1); // + 1 for default value
-  for (const auto& item : content) {
-    content_.push_back(resolve_content(item, context));
-  }
-  if ( content_.size() != stride ) {
+  if ( content.Size() != stride ) {
     throw std::runtime_error("Inconsistency in MultiBinning: number of content nodes does not match binning");
   }
+  const auto common = sparse_common(content.Size(), [&content](size_t i) -> std::optional<double> {
+      if ( content[i].IsNumber() ) return content[i].GetDouble();
+      return std::nullopt;
+    });
+  std::vector<size_t> cells;
+  if ( common ) {
+    // only the cells that differ from the common constant are resolved
+    content_.push_back(*common);
+    for (size_t i=0; i < content.Size(); ++i) {
+      if ( content[i].IsNumber() && same_bits(content[i].GetDouble(), *common) ) continue;
+      cells.push_back(i);
+      content_.push_back(resolve_content(content[i], context));
+    }
+  }
+  else {
+    content_.reserve(content.Size() + 1); // + 1 for default value
+    for (const auto& item : content) {
+      content_.push_back(resolve_content(item, context));
+    }
+  }
 
   const auto& flowbehavior = json.getRequiredValue("flow");
   flow_ = parse_flow_behavior(flowbehavior);
   if (flow_ == detail::FlowBehavior::value) {
       content_.push_back(resolve_content(flowbehavior, context));
+      cells.push_back(stride);
+  }
+  if ( common ) sparse_ = sparse_cells(cells, ncells());
+  pack_constants(content_, values_);
+}
+
+size_t MultiBinning::ncells() const
+{
+  const size_t nbins = axes_.empty() ? 1 : axes_.front().stride * axes_.front().nbins;
+  return nbins + ( flow_ == detail::FlowBehavior::value );
+}
+
+size_t MultiBinning::slot(size_t cell) const
+{
+  if ( sparse_.empty() ) return cell;
+  const auto& word = sparse_[cell / 64];
+  const uint64_t bit = uint64_t{1} << (cell % 64);
+  if ( (word.mask & bit) == 0 ) return 0;
+  return 1 + word.before + std::bitset<64>(word.mask & (bit - 1)).count();
+}
+
+size_t MultiBinning::local_index(const detail::MultiBinningAxis& axis, double value) const
+{
+  // out of range values (and NaN), and wrap, take the general path
+  if ( ! (value >= axis.low && value < axis.high) || flow_ == detail::FlowBehavior::wrap ) {
+    return find_bin_idx_nothrow(value, axis.bins, flow_);
+  }
+  if ( axis.scale != 0. ) {
+    const double scaled = (value - axis.low) * axis.scale;
+    const size_t idx = static_cast<size_t>(scaled);
+    // near an edge, the result may differ from find_bin_idx by rounding
+    const double frac = scaled - idx;
+    if ( frac < axis.tolerance || frac > 1. - axis.tolerance ) {
+      return find_bin_idx_nothrow(value, axis.bins, flow_);
+    }
+    return idx;
+  }
+  const auto& edges = *std::get<detail::NonUniformBins>(axis.bins);
+  if ( axis.linear ) {
+    size_t idx {0};
+    for (size_t i=1; i < axis.nbins; ++i) idx += ( edges[i] <= value );
+    return idx;
   }
+  return std::upper_bound(edges.begin() + 1, edges.end() - 1, value) - edges.begin() - 1;
 }
 
-double MultiBinning::evaluate(const std::vector<Variable::Type>& values) const
+double MultiBinning::evaluate(const detail::InputView& values) const
 {
   size_t idx {0};
-  size_t localidx {0};
-  size_t dim {0};
 
-  for (const auto& [variableIdx, stride, edgesVariant] : axes_) {
-    localidx = find_bin_idx(values[variableIdx], edgesVariant, flow_, variableIdx, "MultiBinning");
-    if ( localidx == nbins(dim) ) // find_bin_idx is indicating we need to return the default value
-      return std::visit(node_evaluate{values}, content_.back());
-    idx += localidx * stride;
-    ++dim;
+  for (const auto& axis : axes_) {
+    const double value = values[axis.variableIdx].number();
+    const size_t localidx = local_index(axis, value);
+    if ( localidx == bin_failed ) {
+      find_bin_idx(value, axis.bins, flow_, axis.variableIdx, "MultiBinning"); // raises
+    }
+    if ( localidx == axis.nbins ) { // find_bin_idx is indicating we need to return the default value
+      idx = ncells() - 1;
+      break;
+    }
+    idx += localidx * axis.stride;
   }
 
-  const Content& child = content_.at(idx);
-  return std::visit(node_evaluate{values}, child);
+  idx = slot(idx);
+  if ( ! values_.empty() ) return values_[idx];
+  return std::visit(node_evaluate{values}, content_[idx]);
+}
+
+void MultiBinning::route(const detail::BatchView& values, size_t * out) const
+{
+  // one axis at a time, the default value and failures are flagged by out of range indices
+  const size_t ncells = this->ncells();
+  const size_t nodefault = bin_failed;
+  const size_t failed = failed_route(Correction::EntryStatus::out_of_range);
+  std::fill(out, out + values.size(), 0);
+  for (const auto& axis : axes_) {
+    const auto& column = values[axis.variableIdx];
+    const size_t * cached = detail::BinIndexCache::find(values, axis.bins, flow_, axis.variableIdx);
+    // a broadcast column is in the same bin for all entries
+    const size_t broadcast = column.broadcast() ? local_index(axis, column[0].number()) : 0;
+    for (size_t i=0; i < values.size(); ++i) {
+      if ( out[i] >= ncells ) continue;
+      const size_t localidx = column.broadcast() ? broadcast
+        : ( cached != nullptr && cached[i] != detail::BinIndexCache::outside ) ? cached[i]
+        : local_index(axis, column[i].number());
+      if ( localidx == bin_failed ) out[i] = failed;
+      else out[i] = ( localidx == axis.nbins ) ? nodefault : out[i] + localidx * axis.stride;
+    }
+  }
+  for (size_t i=0; i < values.size(); ++i) {
+    if ( out[i] == nodefault ) out[i] = ncells - 1;
+  }
+}
+
+void MultiBinning::evaluate(const detail::BatchView& values, double * out) const
+{
+  detail::ScratchBuffer<size_t> route(values.scratch(), values.size());
+  this->route(values, route.data());
+  if ( sparse() ) {
+    const size_t ncells = this->ncells();
+    for (auto& k : route) {
+      if ( k < ncells ) k = slot(k);
+    }
+  }
+  if ( ! values_.empty() ) {
+    for (size_t i=0; i < values.size(); ++i) {
+      out[i] = ( route[i] < values_.size() ) ? values_[route[i]] : failed_value(route_status(route[i]));
+    }
+    return;
+  }
+  evaluate_routed(values, route.data(), content_.size(), [this](size_t k) -> const Content& { return content_[k]; }, out);
+}
+
+Content MultiBinning::specialize(const detail::Specialization& spec) const
+{
+  // resolve the fixed axes to a content offset, keep the others
+  size_t offset {0};
+  std::vector<size_t> freeDims;
+  for (size_t dim=0; dim < axes_.size(); ++dim) {
+    const auto& axis = axes_[dim];
+    if ( ! spec.fixed(axis.variableIdx) ) {
+      freeDims.push_back(dim);
+      continue;
+    }
+    size_t localidx = find_bin_idx(InputValue(spec.value(axis.variableIdx)).number(), axis.bins, flow_, axis.variableIdx, "MultiBinning");
+    if ( localidx == nbins(dim) ) {
+      const size_t k = slot(ncells() - 1);
+      if ( ! values_.empty() ) return values_[k];
+      return std::visit(node_specialize{spec}, content_[k]);
+    }
+    offset += localidx * axis.stride;
+  }
+  if ( freeDims.empty() ) {
+    if ( ! values_.empty() ) return values_.at(slot(offset));
+    return std::visit(node_specialize{spec}, content_.at(slot(offset)));
+  }
+
+  MultiBinning out;
+  out.flow_ = flow_;
+  size_t stride {1};
+  for (auto it=freeDims.rbegin(); it != freeDims.rend(); ++it) {
+    const auto& axis = axes_[*it];
+    out.axes_.push_back(make_axis(spec.remap[axis.variableIdx], stride, axis.bins));
+    stride *= nbins(*it);
+  }
+  std::reverse(out.axes_.begin(), out.axes_.end());
+
+  // walk the remaining cells in row-major order of the free axes
+  const bool constants = ! values_.empty();
+  if ( constants ) out.values_.reserve(stride + 1);
+  else out.content_.reserve(stride + 1);
+  std::vector<size_t> local(freeDims.size(), 0);
+  for (size_t i=0; i < stride; ++i) {
+    size_t idx {offset};
+    for (size_t j=0; j < freeDims.size(); ++j) idx += local[j] * axes_[freeDims[j]].stride;
+    idx = slot(idx);
+    if ( constants ) out.values_.push_back(values_[idx]);
+    else if ( spec.tabulation ) {
+      detail::Specialization inner(spec);
+      for (size_t j=0; j < freeDims.size(); ++j) {
+        const auto& axis = axes_[freeDims[j]];
+        narrow(inner, axis.variableIdx, bin_range(axis.bins, flow_, local[j]));
+      }
+      out.content_.push_back(specialize_branch(content_[idx], inner));
+    }
+    else out.content_.push_back(specialize_branch(content_[idx], spec));
+    for (size_t j=freeDims.size(); j-- > 0; ) {
+      if ( ++local[j] < nbins(freeDims[j]) ) break;
+      local[j] = 0;
+    }
+  }
+  if ( flow_ == detail::FlowBehavior::value ) {
+    if ( constants ) out.values_.push_back(values_.back());
+    else out.content_.push_back(specialize_branch(content_.back(), spec));
+  }
+  // fixing inputs may have reduced all children to constants
+  pack_constants(out.content_, out.values_);
+  if ( spec.coalesced ) out.coalesce(spec.target, *spec.coalesced);
+  out.sparsify();
+  return out;
+}
+
+void MultiBinning::coalesce(const Correction& context, size_t& removed)
+{
+  if ( sparse() ) return; // only called on the dense result of specialize
+  const bool constants = ! values_.empty();
+  auto same = [&](size_t a, size_t b) {
+    return constants ? same_bits(values_[a], values_[b]) : detail::SameContent{}(content_[a], content_[b]);
+  };
+  // one axis at a time, as for Binning::coalesce: bins k and k+1 of an axis
+  // merge if all the cells they hold are equal
+  for (size_t d=0; d < axes_.size(); ++d) {
+    const auto* bins = std::get_if<detail::NonUniformBins>(&axes_[d].bins);
+    if ( bins == nullptr ) continue;
+    const auto& edges = **bins;
+    const size_t nbins = axes_[d].nbins;
+    const size_t stride = axes_[d].stride;
+    const size_t nouter = ( ncells() - ( flow_ == detail::FlowBehavior::value ) ) / (nbins * stride);
+    auto same_slice = [&](size_t a, size_t b) {
+      for (size_t o=0; o < nouter; ++o) {
+        for (size_t i=0; i < stride; ++i) {
+          if ( ! same((o * nbins + a) * stride + i, (o * nbins + b) * stride + i) ) return false;
+        }
+      }
+      return true;
+    };
+    std::vector<size_t> first{0};
+    for (size_t k=1; k < nbins; ++k) {
+      if ( ! same_slice(first.back(), k) ) first.push_back(k);
+    }
+    if ( first.size() == nbins ) continue;
+    removed += nbins - first.size();
+
+    // each cell kept is read once, in order, so it can be moved forward
+    size_t next {0};
+    for (size_t o=0; o < nouter; ++o) {
+      for (size_t k : first) {
+        for (size_t i=0; i < stride; ++i, ++next) {
+          const size_t cell = (o * nbins + k) * stride + i;
+          if ( constants ) values_[next] = values_[cell];
+          else if ( next != cell ) content_[next] = std::move(content_[cell]);
+        }
+      }
+    }
+    if ( flow_ == detail::FlowBehavior::value ) {
+      if ( constants ) values_[next] = values_.back();
+      else content_[next] = std::move(content_.back());
+      ++next;
+    }
+    if ( constants ) values_.resize(next);
+    else content_.erase(content_.begin() + next, content_.end());
+
+    std::vector<double> merged;
+    merged.reserve(first.size() + 1);
+    for (size_t k : first) merged.push_back(edges[k]);
+    merged.push_back(edges.back());
+    axes_[d] = make_axis(axes_[d].variableIdx, 0, context.edges(std::move(merged)));
+    size_t outer {1};
+    for (auto it=axes_.rbegin(); it != axes_.rend(); ++it) {
+      it->stride = outer;
+      outer *= it->nbins;
+    }
+  }
+}
+
+void MultiBinning::sparsify()
+{
+  if ( sparse() ) return;
+  const bool hasDefault = ( flow_ == detail::FlowBehavior::value );
+  const size_t nbins = ncells() - hasDefault;
+  const bool constants = ! values_.empty();
+  const auto common = sparse_common(nbins, [&](size_t i) -> std::optional<double> {
+      if ( constants ) return values_[i];
+      if ( const auto* value = std::get_if<double>(&content_[i]) ) return *value;
+      return std::nullopt;
+    });
+  if ( ! common ) return;
+  std::vector<size_t> cells;
+  if ( constants ) {
+    std::vector<double> values{*common};
+    for (size_t i=0; i < nbins; ++i) {
+      if ( same_bits(values_[i], *common) ) continue;
+      cells.push_back(i);
+      values.push_back(values_[i]);
+    }
+    if ( hasDefault ) {
+      cells.push_back(nbins);
+      values.push_back(values_.back());
+    }
+    values_ = std::move(values);
+  }
+  else {
+    std::vector<Content> content;
+    content.push_back(*common);
+    for (size_t i=0; i < nbins; ++i) {
+      const auto* value = std::get_if<double>(&content_[i]);
+      if ( value != nullptr && same_bits(*value, *common) ) continue;
+      cells.push_back(i);
+      content.push_back(std::move(content_[i]));
+    }
+    if ( hasDefault ) {
+      cells.push_back(nbins);
+      content.push_back(std::move(content_.back()));
+    }
+    content_ = std::move(content);
+  }
+  sparse_ = sparse_cells(cells, ncells());
 }
 
-size_t MultiBinning::nbins(size_t dimension) const
+Content MultiBinning::fused(Content&& node)
 {
-  if ( const auto *bins = std::get_if<detail::UniformBins>(&axes_[dimension].bins) )
-    return bins->n; // using uniform bins
+  // the axes, flow and contents (default last) of a binned node
+  struct Level {
+    std::vector<detail::MultiBinningAxis> axes;
+    detail::FlowBehavior flow;
+    std::vector<Content> * content;
+    std::vector<double> * values;
+    const MultiBinning * multi; // to locate the cells of a sparse table
+
+    size_t slot(size_t cell) const { return multi ? multi->slot(cell) : cell; }
+    size_t ncells() const {
+      size_t n {1};
+      for (const auto& axis : axes) n *= axis.nbins;
+      return n;
+    }
+    // the default value, if it is a constant
+    std::optional<double> fallback() const {
+      if ( ! values->empty() ) return values->back();
+      if ( const auto* value = std::get_if<double>(&content->back()) ) return *value;
+      return std::nullopt;
+    }
+  };
+  auto level = [](Content& item) -> std::optional<Level> {
+    if ( auto* binning = std::get_if<Binning>(&item) ) {
+      return Level{{make_axis(binning->variableIdx_, 1, binning->bins_)}, binning->flow_, &binning->contents_, &binning->values_, nullptr};
+    }
+    if ( auto* multi = std::get_if<MultiBinning>(&item) ) {
+      return Level{multi->axes_, multi->flow_, &multi->content_, &multi->values_, multi};
+    }
+    return std::nullopt;
+  };
 
-  // otherwise we must have non-uniform bins
-  const auto &bins = std::get<detail::NonUniformBins>(axes_[dimension].bins);
-  return bins.size() - 1;
+  const auto outer = level(node);
+  if ( ! outer || ! outer->values->empty() ) return std::move(node);
+  const size_t ncells = outer->ncells();
+  const bool hasDefault = ( outer->flow == detail::FlowBehavior::value );
+  // a single default for all levels: the first axis out of range selects it
+  std::optional<double> fallback;
+  if ( hasDefault ) {
+    fallback = outer->fallback();
+    if ( ! fallback ) return std::move(node);
+  }
+  std::vector<Level> inner;
+  inner.reserve(ncells);
+  for (size_t k=0; k < ncells; ++k) {
+    auto child = level((*outer->content)[outer->slot(k)]);
+    if ( ! child || child->flow != outer->flow ) return std::move(node);
+    const auto& axes = inner.empty() ? child->axes : inner.front().axes;
+    if ( child->axes.size() != axes.size() ) return std::move(node);
+    for (size_t j=0; j < axes.size(); ++j) {
+      if ( child->axes[j].variableIdx != axes[j].variableIdx || ! same_edges(child->axes[j].bins, axes[j].bins) ) return std::move(node);
+    }
+    if ( hasDefault && child->fallback() != fallback ) return std::move(node);
+    inner.push_back(std::move(*child));
+  }
+
+  // outer axes first, so that they are checked (and raise) before the inner ones
+  MultiBinning out;
+  out.flow_ = outer->flow;
+  for (const auto& axis : outer->axes) out.axes_.push_back(make_axis(axis.variableIdx, 0, axis.bins));
+  for (const auto& axis : inner.front().axes) out.axes_.push_back(make_axis(axis.variableIdx, 0, axis.bins));
+  size_t stride {1};
+  for (auto it=out.axes_.rbegin(); it != out.axes_.rend(); ++it) {
+    it->stride = stride;
+    stride *= it->nbins;
+  }
+  const size_t ninner = inner.front().ncells();
+  out.content_.reserve(stride + 1);
+  for (auto& child : inner) {
+    for (size_t j=0; j < ninner; ++j) {
+      const size_t s = child.slot(j);
+      if ( ! child.values->empty() ) out.content_.push_back((*child.values)[s]);
+      // in a sparse child, the shared slot is a constant and survives the move
+      else out.content_.push_back(std::move((*child.content)[s]));
+    }
+  }
+  if ( hasDefault ) out.content_.push_back(*fallback);
+  pack_constants(out.content_, out.values_);
+  out.sparsify();
+  return out;
 }
 
 Category::Category(const JSONObject& json, const Correction& context)
 {
   variableIdx_ = detail::find_input_index(json.getRequired<std::string_view>("input"), context.inputs());
   const auto& variable = context.inputs()[variableIdx_];
-  if ( variable.type() == Variable::VarType::string ) {
-    map_ = StrMap();
-  } // (default-constructed as IntMap)
+  std::vector<int64_t> intKeys;
+  std::vector<std::string> strKeys;
+  // first occurrence of a key wins
+  std::unordered_set<int64_t> seenInt;
+  std::unordered_set<std::string> seenStr;
   for (const auto& kv_pair : json.getRequired<rapidjson::Value::ConstArray>("content"))
   {
     if ( ! (kv_pair.IsObject() && kv_pair.HasMember("key") && kv_pair.HasMember("value")) ) {
@@ -577,56 +1823,730 @@ Category::Category(const JSONObject& json, const Correction& context)
       if ( variable.type() != Variable::VarType::string ) {
         throw std::runtime_error("Category got a key of type string, but its input is type " + variable.typeStr());
       }
-      std::get<StrMap>(map_).try_emplace(kv_pair["key"].GetString(), resolve_content(kv_pair["value"], context));
+      auto value = resolve_content(kv_pair["value"], context);
+      if ( seenStr.insert(kv_pair["key"].GetString()).second ) {
+        strKeys.push_back(kv_pair["key"].GetString());
+        content_.push_back(std::move(value));
+      }
     }
     else if ( kv_pair["key"].IsInt() ) {
       if ( variable.type() != Variable::VarType::integer ) {
         throw std::runtime_error("Category got a key of type int, but its input is type " + variable.typeStr());
       }
-      std::get<IntMap>(map_).try_emplace(kv_pair["key"].GetInt(), resolve_content(kv_pair["value"], context));
+      auto value = resolve_content(kv_pair["value"], context);
+      if ( seenInt.insert(kv_pair["key"].GetInt()).second ) {
+        intKeys.push_back(kv_pair["key"].GetInt());
+        content_.push_back(std::move(value));
+      }
     }
     else {
       throw std::runtime_error("Invalid key type in Category");
     }
   }
 
+  if ( variable.type() == Variable::VarType::string ) {
+    table_ = build_category_table(strKeys);
+  }
+  else {
+    table_ = build_category_table(intKeys);
+  }
+
   const auto def = json.FindMember("default");
   if ( def != json.MemberEnd() && ! def->value.IsNull() ) {
     default_ = std::make_unique<Content>(resolve_content(def->value, context));
   }
 }
 
-double Category::evaluate(const std::vector<Variable::Type>& values) const {
-  const Content* child = nullptr;
-  if ( auto pval = std::get_if<std::string>(&values[variableIdx_]) ) {
-    const auto& m = std::get<StrMap>(map_);
-    auto it = m.find(*pval);
-    if ( it != m.end() ) {
-      child = &it->second;
-    } else if ( default_ ) {
-      child = default_.get();
-    } else {
-      throw std::out_of_range("Index not available in Category for input argument " + std::to_string(variableIdx_) + " val: " + *pval);
+size_t Category::find(int64_t key) const {
+  if ( const auto* table = std::get_if<detail::DenseIntTable>(&table_) ) {
+    // negative differences wrap around to large values
+    const uint64_t pos = static_cast<uint64_t>(key) - static_cast<uint64_t>(table->offset);
+    return ( pos < table->slots.size() ) ? table->slots[pos] : content_.size();
+  }
+  const auto& table = std::get<detail::IntHashTable>(table_);
+  const size_t mask = table.slots.size() - 1;
+  for (size_t pos = (static_cast<uint64_t>(key) * fibonacci_multiplier) >> table.shift; ; pos = (pos + 1) & mask) {
+    if ( table.slots[pos] == empty_slot ) return content_.size();
+    if ( table.keys[pos] == key ) return table.slots[pos];
+  }
+}
+
+size_t Category::find(std::string_view key) const {
+  const auto& table = std::get<detail::StrHashTable>(table_);
+  const uint64_t hash = XXH3_64bits(key.data(), key.size());
+  for (size_t pos = hash & table.mask; ; pos = (pos + 1) & table.mask) {
+    if ( table.slots[pos] == empty_slot ) return content_.size();
+    if ( table.hashes[pos] == hash && table.keys[pos] == key ) return table.slots[pos];
+  }
+}
+
+size_t Category::position(const InputValue& value) const {
+  size_t pos;
+  if ( value.type() == Variable::VarType::string ) {
+    pos = find(value.string());
+    if ( pos == content_.size() && ! default_ ) {
+      throw std::out_of_range("Index not available in Category for input argument " + std::to_string(variableIdx_) + " val: " + std::string(value.string()));
     }
   }
-  else if ( auto pval = std::get_if<int64_t>(&values[variableIdx_]) ) {
-    const auto& m = std::get<IntMap>(map_);
-    auto it = m.find(*pval);
-    if ( it != m.end() ) {
-      child = &it->second;
-    } else if ( default_ ) {
-      child = default_.get();
-    } else {
-      throw std::out_of_range("Index not available in Category for input argument " + std::to_string(variableIdx_) + " val: " + std::to_string(*pval));
+  else if ( value.type() == Variable::VarType::integer ) {
+    pos = find(value.integer());
+    if ( pos == content_.size() && ! default_ ) {
+      throw std::out_of_range("Index not available in Category for input argument " + std::to_string(variableIdx_) + " val: " + std::to_string(value.integer()));
     }
   } else {
     throw std::runtime_error("Invalid variable type");
   }
+  return pos;
+}
+
+double Category::evaluate(const detail::InputView& values) const {
+  return std::visit(node_evaluate{values}, child(position(values[variableIdx_])));
+}
+
+void Category::route(const detail::BatchView& values, size_t * out) const {
+  const auto& column = values[variableIdx_];
+  const size_t missing = default_ ? content_.size() : failed_route(Correction::EntryStatus::missing_key);
+  if ( column.type() == Variable::VarType::string ) {
+    for (size_t i=0; i < values.size(); ++i) {
+      const size_t pos = find(column[i].string());
+      out[i] = ( pos == content_.size() ) ? missing : pos;
+    }
+  }
+  else {
+    for (size_t i=0; i < values.size(); ++i) {
+      const size_t pos = find(column[i].integer());
+      out[i] = ( pos == content_.size() ) ? missing : pos;
+    }
+  }
+}
+
+void Category::evaluate(const detail::BatchView& values, double * out) const {
+  // there may be no child to evaluate an empty batch with
+  if ( values.size() == 0 ) return;
+  if ( values[variableIdx_].broadcast() ) {
+    // the same child for all entries
+    size_t pos;
+    route(detail::BatchView(values.columns(), values.ncolumns(), 1), &pos);
+    if ( pos > content_.size() ) {
+      std::fill(out, out + values.size(), failed_value(route_status(pos)));
+      return;
+    }
+    std::visit(node_evaluate_batch{values, out}, child(pos));
+    return;
+  }
+  detail::ScratchBuffer<size_t> route(values.scratch(), values.size());
+  this->route(values, route.data());
+  evaluate_routed(values, route.data(), content_.size() + 1, [this](size_t k) -> const Content& { return child(k); }, out);
+}
+
+Content Category::specialize(const detail::Specialization& spec) const {
+  if ( spec.fixed(variableIdx_) ) {
+    const auto& value = spec.value(variableIdx_);
+    size_t pos;
+    if ( auto pval = std::get_if<std::string>(&value) ) {
+      pos = find(*pval);
+      if ( pos == content_.size() && ! default_ ) {
+        throw std::out_of_range("Index not available in Category for input argument " + std::to_string(variableIdx_) + " val: " + *pval);
+      }
+    }
+    else {
+      const int64_t key = std::get<int64_t>(value);
+      pos = find(key);
+      if ( pos == content_.size() && ! default_ ) {
+        throw std::out_of_range("Index not available in Category for input argument " + std::to_string(variableIdx_) + " val: " + std::to_string(key));
+      }
+    }
+    const Content& child = ( pos < content_.size() ) ? content_[pos] : *default_;
+    return std::visit(node_specialize{spec}, child);
+  }
+  Category out;
+  out.variableIdx_ = spec.remap[variableIdx_];
+  out.content_.reserve(content_.size());
+  out.table_ = table_;
+  if ( default_ ) {
+    for (const auto& child : content_) {
+      out.content_.push_back(specialize_branch(child, spec));
+    }
+    out.default_ = std::make_unique<Content>(specialize_branch(*default_, spec));
+    return out;
+  }
+  // Without a default, a child that always fails for the fixed values can be
+  // dropped along with its key, since looking the key up will then throw.
+  // newpos is the position in out.content_ of each child, the last entry is for missing keys
+  std::vector<uint32_t> newpos;
+  newpos.reserve(content_.size() + 1);
+  for (const auto& child : content_) {
+    try {
+      out.content_.push_back(std::visit(node_specialize{spec}, child));
+      newpos.push_back(out.content_.size() - 1);
+    }
+    catch (const std::out_of_range&) { newpos.push_back(empty_slot); }
+    catch (const std::runtime_error&) { newpos.push_back(empty_slot); }
+  }
+  newpos.push_back(empty_slot);
+  for (auto& pos : newpos) {
+    if ( pos == empty_slot ) pos = out.content_.size();
+  }
+  std::visit([&newpos](auto& table) {
+      for (auto& slot : table.slots) {
+        if ( slot != empty_slot ) slot = newpos[slot];
+      }
+    }, out.table_);
+  return out;
+}
+
+namespace correction::detail {
+  // A bounded memo of Correction results. Each thread has its own table,
+  // set-associative with least recently used replacement within a set, keyed
+  // on the input value bits so that a hit returns exactly what evaluation
+  // would have. Only the counters are shared between threads.
+  class EvaluationCache : public std::enable_shared_from_this<EvaluationCache> {
+    public:
+      explicit EvaluationCache(size_t capacity) : capacity_(capacity), id_(next_id_++) {
+        if ( capacity == 0 ) {
+          throw std::invalid_argument("Cache capacity must be positive");
+        }
+      }
+      size_t capacity() const { return capacity_; }
+      uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+      uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+      template<typename F>
+      double lookup(const InputValue * values, size_t size, F&& evaluate) const {
+        Table& t = table();
+        encode_key(values, size, t.key);
+        const uint64_t hash = XXH3_64bits(t.key.data(), t.key.size());
+        Entry * set = t.entries.data() + (hash & t.mask) * ways;
+        Entry * oldest = set;
+        for (Entry * entry = set; entry != set + ways; ++entry) {
+          if ( entry->used && entry->hash == hash && entry->key == t.key ) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            entry->used = ++t.clock;
+            return entry->value;
+          }
+          if ( entry->used < oldest->used ) oldest = entry;
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        const double value = evaluate();
+        oldest->hash = hash;
+        oldest->key.assign(t.key);
+        oldest->value = value;
+        oldest->used = ++t.clock;
+        return value;
+      }
+
+    private:
+      static constexpr size_t ways {4};
+      struct Entry {
+        uint64_t hash;
+        std::string key;
+        double value;
+        uint64_t used {0}; // last use, zero if empty
+      };
+      struct Table {
+        uint64_t mask; // the set of a key is hash & mask
+        std::vector<Entry> entries;
+        uint64_t clock {0};
+        std::string key; // scratch
+      };
+      // the tables of this thread, by cache id. They are owned by their cache,
+      // so that they are freed with it, and returned to it when the thread exits.
+      struct Tables {
+        struct Ref {
+          std::weak_ptr<const EvaluationCache> owner;
+          Table * table;
+        };
+        uint64_t last_id {0};
+        Table * last {nullptr};
+        std::unordered_map<uint64_t, Ref> tables;
+        ~Tables() {
+          for (const auto& [id, ref] : tables) {
+            if ( auto owner = ref.owner.lock() ) owner->drop(ref.table);
+          }
+        }
+      };
+
+      // numbers as their 8 bytes, strings as size and data
+      static void encode_key(const InputValue * values, size_t size, std::string& key) {
+        key.clear();
+        for (size_t i=0; i < size; ++i) {
+          const auto& value = values[i];
+          if ( value.type() == Variable::VarType::string ) {
+            const uint64_t n = value.string().size();
+            key.append(reinterpret_cast<const char*>(&n), sizeof(n));
+            key.append(value.string());
+          }
+          else if ( value.type() == Variable::VarType::integer ) {
+            const int64_t v = value.integer();
+            key.append(reinterpret_cast<const char*>(&v), sizeof(v));
+          }
+          else {
+            const double v = value.real();
+            key.append(reinterpret_cast<const char*>(&v), sizeof(v));
+          }
+        }
+      }
+
+      Table& table() const {
+        static thread_local Tables tables;
+        if ( tables.last_id == id_ ) return *tables.last;
+        auto it = tables.tables.find(id_);
+        if ( it == tables.tables.end() ) {
+          // first use on this thread: forget the tables of destroyed caches
+          for (auto jt = tables.tables.begin(); jt != tables.tables.end(); ) {
+            if ( jt->second.owner.expired() ) jt = tables.tables.erase(jt);
+            else ++jt;
+          }
+          size_t nsets {1};
+          while ( nsets * ways < capacity_ ) nsets <<= 1;
+          auto table = std::make_unique<Table>(Table{nsets - 1, std::vector<Entry>(nsets * ways), 0, {}});
+          it = tables.tables.emplace(id_, Tables::Ref{weak_from_this(), table.get()}).first;
+          std::lock_guard<std::mutex> lock(mutex_);
+          tables_.push_back(std::move(table));
+        }
+        tables.last_id = id_;
+        tables.last = it->second.table;
+        return *it->second.table;
+      }
+
+      void drop(const Table * table) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tables_.erase(std::find_if(tables_.begin(), tables_.end(),
+              [table](const auto& t) { return t.get() == table; }));
+      }
+
+      static inline std::atomic<uint64_t> next_id_ {1};
+      size_t capacity_;
+      uint64_t id_;
+      mutable std::atomic<uint64_t> hits_ {0};
+      mutable std::atomic<uint64_t> misses_ {0};
+      // the tables of the threads that used the cache
+      mutable std::mutex mutex_;
+      mutable std::vector<std::unique_ptr<Table>> tables_;
+  };
+}
+
+namespace correction::detail {
+  // Evaluates a correction for several keys of a string input at once. The
+  // categories on that input are resolved for each key. Where the resulting
+  // nodes are binnings (or categories on other inputs) that route the same way
+  // for all keys, each entry is routed once and evaluation continues with the
+  // children of every key. Anything else is evaluated one key at a time.
+  class VariationFanout {
+    public:
+      // the node of one key, or a constant if node is null
+      struct Branch {
+        const Content * node;
+        double value;
+      };
+
+      static Branch branch(const Content& node) {
+        if ( const auto* value = std::get_if<double>(&node) ) return {nullptr, *value};
+        return {&node, 0.};
+      }
+
+      VariationFanout(size_t variableIdx, const std::vector<std::string>& keys) :
+        variableIdx_(variableIdx), keys_(keys) {}
+
+      // writes out[k*stride + i] for the key k and the entry i of values
+      void evaluate(std::vector<Branch> branches, const BatchView& values, double * out, size_t stride) const {
+        for (size_t k=0; k < branches.size(); ++k) resolve(branches[k], k);
+        if ( std::all_of(branches.begin(), branches.end(), [](const Branch& b) { return b.node == nullptr; }) ) {
+          for (size_t k=0; k < branches.size(); ++k) std::fill(out + k*stride, out + k*stride + values.size(), branches[k].value);
+          return;
+        }
+        if ( shared<Binning>(branches, [](const Binning& a, const Binning& b) {
+                return a.variableIdx_ == b.variableIdx_ && a.flow_ == b.flow_ && same_edges(a.bins_, b.bins_)
+                  && nchildren(a) == nchildren(b);
+              }) ) {
+          const auto& first = std::get<Binning>(*branches[0].node);
+          std::vector<size_t> route(values.size());
+          first.route(values, route.data());
+          if ( packed<Binning>(branches, route, out, stride) ) return;
+          evaluate_routed(values, route.data(), nchildren(first), [&](size_t k, size_t c) {
+              const auto& node = std::get<Binning>(*branches[k].node);
+              return node.values_.empty() ? branch(node.contents_[c]) : Branch{nullptr, node.values_[c]};
+            }, branches.size(), out, stride);
+          return;
+        }
+        if ( shared<MultiBinning>(branches, [](const MultiBinning& a, const MultiBinning& b) {
+                if ( a.flow_ != b.flow_ || a.axes_.size() != b.axes_.size() || nchildren(a) != nchildren(b) ) return false;
+                for (size_t d=0; d < a.axes_.size(); ++d) {
+                  const auto& x = a.axes_[d];
+                  const auto& y = b.axes_[d];
+                  if ( x.variableIdx != y.variableIdx || x.stride != y.stride || ! same_edges(x.bins, y.bins) ) return false;
+                }
+                return true;
+              }) ) {
+          const auto& first = std::get<MultiBinning>(*branches[0].node);
+          std::vector<size_t> route(values.size());
+          first.route(values, route.data());
+          if ( packed<MultiBinning>(branches, route, out, stride) ) return;
+          evaluate_routed(values, route.data(), nchildren(first), [&](size_t k, size_t c) {
+              const auto& node = std::get<MultiBinning>(*branches[k].node);
+              const size_t s = node.slot(c);
+              return node.values_.empty() ? branch(node.content_[s]) : Branch{nullptr, node.values_[s]};
+            }, branches.size(), out, stride);
+          return;
+        }
+        if ( shared<Category>(branches, [](const Category& a, const Category& b) {
+                return a.variableIdx_ == b.variableIdx_ && a.content_.size() == b.content_.size()
+                  && bool(a.default_) == bool(b.default_) && same_table(a.table_, b.table_);
+              }) ) {
+          const auto& first = std::get<Category>(*branches[0].node);
+          std::vector<size_t> route(values.size());
+          first.route(values, route.data());
+          evaluate_routed(values, route.data(), first.content_.size() + 1, [&](size_t k, size_t c) {
+              return branch(std::get<Category>(*branches[k].node).child(c));
+            }, branches.size(), out, stride);
+          return;
+        }
+
+        // one key at a time, with the key in the column of the input
+        std::vector<InputColumn> columns;
+        columns.reserve(values.ncolumns());
+        for (size_t j=0; j < values.ncolumns(); ++j) columns.push_back(values[j]);
+        for (size_t k=0; k < branches.size(); ++k) {
+          double * row = out + k*stride;
+          if ( branches[k].node == nullptr ) {
+            std::fill(row, row + values.size(), branches[k].value);
+            continue;
+          }
+          columns[variableIdx_] = InputColumn(InputValue(std::string_view(keys_[k])));
+          const BatchView view(columns.data(), columns.size(), values.size());
+          std::visit(node_evaluate_batch{view, row}, *branches[k].node);
+        }
+      }
+
+    private:
+      // replace the categories on the input by the child of the key
+      void resolve(Branch& branch, size_t k) const {
+        while ( branch.node != nullptr ) {
+          const auto* category = std::get_if<Category>(branch.node);
+          if ( category == nullptr || category->variableIdx_ != variableIdx_ ) return;
+          const size_t pos = category->find(std::string_view(keys_[k]));
+          if ( pos == category->content_.size() && ! category->default_ ) {
+            branch = {nullptr, failed_value(Correction::EntryStatus::missing_key)};
+            return;
+          }
+          branch = VariationFanout::branch(category->child(pos));
+        }
+      }
+
+      // are all branches nodes of type Node that route as the first one?
+      template<typename Node, typename Same>
+      static bool shared(const std::vector<Branch>& branches, Same&& same) {
+        if ( branches[0].node == nullptr ) return false;
+        const auto* first = std::get_if<Node>(branches[0].node);
+        if ( first == nullptr ) return false;
+        for (size_t k=1; k < branches.size(); ++k) {
+          if ( branches[k].node == nullptr ) return false;
+          const auto* node = std::get_if<Node>(branches[k].node);
+          if ( node == nullptr || ! ( node == first || same(*first, *node) ) ) return false;
+        }
+        return true;
+      }
+
+      // if all contents are constants, read them directly
+      template<typename Node>
+      static bool packed(const std::vector<Branch>& branches, const std::vector<size_t>& route, double * out, size_t stride) {
+        for (const auto& branch : branches) {
+          if ( std::get<Node>(*branch.node).values_.empty() ) return false;
+        }
+        for (size_t k=0; k < branches.size(); ++k) {
+          const auto& node = std::get<Node>(*branches[k].node);
+          const size_t n = nchildren(node);
+          for (size_t i=0; i < route.size(); ++i) {
+            out[k*stride + i] = ( route[i] < n ) ? node.values_[slot(node, route[i])] : failed_value(route_status(route[i]));
+          }
+        }
+        return true;
+      }
+
+      // the number of routes of a node, and where the contents of each are stored
+      static size_t nchildren(const Binning& node) { return node.values_.empty() ? node.contents_.size() : node.values_.size(); }
+      static size_t nchildren(const MultiBinning& node) { return node.ncells(); }
+      static size_t slot(const Binning&, size_t route) { return route; }
+      static size_t slot(const MultiBinning& node, size_t route) { return node.slot(route); }
+
+      // as evaluate_routed, for the children child(k, c) of every key k
+      template<typename Child>
+      void evaluate_routed(const BatchView& values, const size_t * route, size_t nchildren, Child&& child,
+          size_t nkeys, double * out, size_t stride) const {
+        const size_t size = values.size();
+        std::vector<size_t> first(nchildren + 1, 0);
+        size_t nfailed {0};
+        for (size_t i=0; i < size; ++i) {
+          if ( route[i] < nchildren ) ++first[route[i] + 1];
+          else {
+            for (size_t k=0; k < nkeys; ++k) out[k*stride + i] = failed_value(route_status(route[i]));
+            ++nfailed;
+          }
+        }
+        std::vector<Branch> children(nkeys);
+        size_t largest {0};
+        for (size_t c=0; c < nchildren; ++c) {
+          if ( first[c + 1] == size ) {
+            // all entries take the same branch: no need to gather
+            for (size_t k=0; k < nkeys; ++k) children[k] = child(k, c);
+            evaluate(std::move(children), values, out, stride);
+            return;
+          }
+          largest = std::max(largest, first[c + 1]);
+          first[c + 1] += first[c];
+        }
+        std::vector<size_t> rows(size - nfailed);
+        {
+          std::vector<size_t> next(first.begin(), first.end() - 1);
+          for (size_t i=0; i < size; ++i) {
+            if ( route[i] < nchildren ) rows[next[route[i]]++] = i;
+          }
+        }
+
+        GatheredBatch gathered(values, largest);
+        std::vector<double> result;
+        for (size_t c=0; c < nchildren; ++c) {
+          const size_t * group = rows.data() + first[c];
+          const size_t n = first[c + 1] - first[c];
+          if ( n == 0 ) continue;
+          bool constant = true;
+          for (size_t k=0; k < nkeys; ++k) {
+            children[k] = child(k, c);
+            constant = constant && children[k].node == nullptr;
+          }
+          if ( constant ) {
+            for (size_t k=0; k < nkeys; ++k) {
+              for (size_t i=0; i < n; ++i) out[k*stride + group[i]] = children[k].value;
+            }
+            continue;
+          }
+          result.resize(nkeys * n);
+          evaluate(children, gathered.gather(group, n), result.data(), n);
+          for (size_t k=0; k < nkeys; ++k) {
+            for (size_t i=0; i < n; ++i) out[k*stride + group[i]] = result[k*n + i];
+          }
+        }
+      }
+
+      size_t variableIdx_;
+      const std::vector<std::string>& keys_;
+  };
+}
+
+double Tabulated::interpolate(const double * x) const {
+  const auto& values = *values_;
+  size_t idx[2];
+  double frac[2];
+  for (size_t k=0; k < axes_.size(); ++k) {
+    const auto& axis = axes_[k];
+    const double t = (x[k] - axis.low) * axis.scale;
+    idx[k] = std::min(static_cast<size_t>(t), axis.n - 2);
+    frac[k] = t - idx[k];
+  }
+  if ( axes_.size() == 1 ) {
+    return values[idx[0]] + frac[0] * (values[idx[0] + 1] - values[idx[0]]);
+  }
+  const size_t n1 = axes_[1].n;
+  const size_t base = idx[0] * n1 + idx[1];
+  const double low = values[base] + frac[1] * (values[base + 1] - values[base]);
+  const double high = values[base + n1] + frac[1] * (values[base + n1 + 1] - values[base + n1]);
+  return low + frac[0] * (high - low);
+}
 
-  return std::visit(node_evaluate{values}, *child);
+double Tabulated::evaluate(const detail::InputView& values) const {
+  double x[2];
+  for (size_t k=0; k < axes_.size(); ++k) {
+    x[k] = values[axes_[k].variableIdx].real();
+    // also false for NaN
+    if ( ! (x[k] >= axes_[k].low && x[k] <= axes_[k].high) ) {
+      return std::visit(node_evaluate{values}, *node_);
+    }
+  }
+  return interpolate(x);
 }
 
-Correction::Correction(const JSONObject& json) :
+void Tabulated::evaluate(const detail::BatchView& values, double * out) const {
+  // double columns are read directly
+  const double * data[2] = {nullptr, nullptr};
+  for (size_t k=0; k < axes_.size(); ++k) {
+    const auto& column = values[axes_[k].variableIdx];
+    if ( ! column.broadcast() && ! column.single() ) data[k] = static_cast<const double*>(column.data());
+  }
+  auto inside = [&](size_t i, double * x) {
+    bool in = true;
+    for (size_t k=0; k < axes_.size(); ++k) {
+      x[k] = data[k] ? data[k][i] : values[axes_[k].variableIdx][i].real();
+      in &= x[k] >= axes_[k].low && x[k] <= axes_[k].high;
+    }
+    return in;
+  };
+  // the entries outside the table are only counted here
+  size_t noutside {0};
+  if ( axes_.size() == 1 && data[0] != nullptr ) {
+    // the common case, inlined
+    const auto& axis = axes_[0];
+    const double * table = values_->data();
+    for (size_t i=0; i < values.size(); ++i) {
+      const double x = data[0][i];
+      if ( ! (x >= axis.low && x <= axis.high) ) {
+        ++noutside;
+        continue;
+      }
+      const double t = (x - axis.low) * axis.scale;
+      const size_t j = std::min(static_cast<size_t>(t), axis.n - 2);
+      out[i] = table[j] + (t - j) * (table[j + 1] - table[j]);
+    }
+  }
+  else {
+    double x[2];
+    for (size_t i=0; i < values.size(); ++i) {
+      if ( inside(i, x) ) out[i] = interpolate(x);
+      else ++noutside;
+    }
+  }
+  if ( noutside == 0 ) return;
+  if ( noutside == values.size() ) {
+    std::visit(node_evaluate_batch{values, out}, *node_);
+    return;
+  }
+  // and collected once some are found, so that batches within the table
+  // need no scratch memory
+  detail::ScratchBuffer<size_t> outside(values.scratch(), noutside);
+  double x[2];
+  for (size_t i=0, j=0; j < noutside; ++i) {
+    if ( ! inside(i, x) ) outside[j++] = i;
+  }
+  GatheredBatch gathered(values, noutside);
+  detail::ScratchBuffer<double> result(values.scratch(), noutside);
+  std::visit(node_evaluate_batch{gathered.gather(outside.data(), noutside), result.data()}, *node_);
+  for (size_t i=0; i < noutside; ++i) out[outside[i]] = result[i];
+}
+
+Content Tabulated::specialize(const detail::Specialization& spec) const {
+  // the node is kept as it is, not tabulated again
+  detail::Specialization inner(spec);
+  inner.tabulation = nullptr;
+  Content node = std::visit(node_specialize{inner}, *node_);
+  for (const auto& axis : axes_) {
+    if ( spec.fixed(axis.variableIdx) ) return node;
+  }
+  Tabulated out;
+  out.axes_ = axes_;
+  for (auto& axis : out.axes_) axis.variableIdx = spec.remap[axis.variableIdx];
+  out.values_ = values_;
+  out.node_ = std::make_unique<Content>(std::move(node));
+  return out;
+}
+
+Content Tabulated::tabulate(Content&& node, const detail::Specialization& spec) {
+  std::vector<size_t> variables;
+  std::string kind;
+  if ( const auto *formula = std::get_if<Formula>(&node) ) {
+    kind = "formula";
+    collect_variables(formula->ast(), variables);
+  }
+  else if ( const auto *ref = std::get_if<FormulaRef>(&node) ) {
+    kind = "formularef";
+    collect_variables(ref->formula().ast(), variables);
+  }
+  else if ( const auto *nn = std::get_if<LWTNN>(&node) ) {
+    kind = "lwtnn";
+    variables = nn->variables();
+  }
+  else {
+    return std::move(node);
+  }
+  std::sort(variables.begin(), variables.end());
+  variables.erase(std::unique(variables.begin(), variables.end()), variables.end());
+  // tabulated fixes no inputs: the indices are the same in source and target
+  const auto& inputs = spec.target.inputs();
+  if ( variables.empty() || variables.size() > 2 ) return std::move(node);
+  for (size_t idx : variables) {
+    if ( inputs[idx].type() != Variable::VarType::real ) return std::move(node);
+  }
+
+  const auto& options = spec.tabulation->options;
+  const size_t ndims = variables.size();
+  Correction::TabulationEntry entry{kind, {}, {}, 0, std::numeric_limits<double>::quiet_NaN(), 0, false};
+  bool bounded = true;
+  for (size_t idx : variables) {
+    entry.inputs.push_back(inputs[idx].name());
+    entry.domain.push_back(spec.domain[idx]);
+    bounded &= std::isfinite(spec.domain[idx].first) && std::isfinite(spec.domain[idx].second)
+      && spec.domain[idx].first < spec.domain[idx].second;
+  }
+
+  // evaluate node at the points given by one column per variable
+  std::vector<InputColumn> columns(inputs.size(), InputColumn(InputValue(0.)));
+  auto sample = [&](const std::vector<std::vector<double>>& points, std::vector<double>& out) {
+    for (size_t k=0; k < ndims; ++k) columns[variables[k]] = InputColumn(points[k].data());
+    out.resize(points[0].size());
+    std::visit(node_evaluate_batch{detail::BatchView(columns.data(), columns.size(), out.size()), out.data()}, node);
+  };
+
+  Tabulated out;
+  // points per axis, doubling the cells until the check sample passes
+  size_t n = ( ndims == 1 ) ? 17 : 9;
+  const size_t check = ( ndims == 1 ) ? 5 : 3; // check points per cell and axis
+  while ( bounded && ( ndims == 1 ? n : n * n ) <= options.max_points ) {
+    out.axes_.clear();
+    for (size_t k=0; k < ndims; ++k) {
+      const auto [low, high] = spec.domain[variables[k]];
+      out.axes_.push_back({variables[k], n, low, high, (n - 1) / (high - low)});
+    }
+    const size_t npoints = ( ndims == 1 ) ? n : n * n;
+    const size_t ncheck = ( ndims == 1 ) ? (n - 1) * check : (n - 1) * check * (n - 1) * check;
+    std::vector<std::vector<double>> grid(ndims, std::vector<double>(npoints));
+    std::vector<std::vector<double>> checks(ndims, std::vector<double>(ncheck));
+    for (size_t k=0; k < ndims; ++k) {
+      const auto& axis = out.axes_[k];
+      const size_t inner = ( k + 1 < ndims ) ? n : 1; // repeats of each value along the faster axes
+      const size_t inner_check = ( k + 1 < ndims ) ? (n - 1) * check : 1;
+      for (size_t i=0; i < npoints; ++i) {
+        const size_t j = (i / inner) % n;
+        grid[k][i] = ( j + 1 == n ) ? axis.high : axis.low + (axis.high - axis.low) * j / (n - 1);
+      }
+      for (size_t i=0; i < ncheck; ++i) {
+        const size_t j = (i / inner_check) % ((n - 1) * check);
+        checks[k][i] = axis.low + (axis.high - axis.low) * ((j / check) + (j % check + 0.5) / check) / (n - 1);
+      }
+    }
+    auto values = std::make_shared<std::vector<double>>();
+    std::vector<double> exact;
+    sample(grid, *values);
+    sample(checks, exact);
+    out.values_ = values;
+
+    double error = 0.;
+    double x[2];
+    for (size_t i=0; i < ncheck; ++i) {
+      for (size_t k=0; k < ndims; ++k) x[k] = checks[k][i];
+      const double diff = std::abs(out.interpolate(x) - exact[i]);
+      // NaN or infinite values anywhere: not smooth
+      error = std::isfinite(diff) ? std::max(error, diff) : std::numeric_limits<double>::infinity();
+    }
+    for (double v : *values) {
+      if ( ! std::isfinite(v) ) error = std::numeric_limits<double>::infinity();
+    }
+    entry.points = npoints;
+    entry.max_error = error;
+    entry.bytes = npoints * sizeof(double);
+    if ( error <= options.tolerance ) {
+      entry.tabulated = true;
+      break;
+    }
+    if ( std::isinf(error) ) break;
+    n = 2 * n - 1;
+  }
+  if ( spec.tabulation->report ) spec.tabulation->report->push_back(entry);
+  if ( ! entry.tabulated ) return std::move(node);
+  out.node_ = std::make_unique<Content>(std::move(node));
+  return out;
+}
+
+Correction::Correction(const JSONObject& json) : Correction(json, nullptr) {}
+
+Correction::Correction(const JSONObject& json, detail::EdgesTable * edges) :
   name_(json.getRequired<const char *>("name")),
   description_(json.getOptional<const char*>("description").value_or("")),
   version_(json.getRequired<int>("version")),
@@ -644,22 +2564,376 @@ Correction::Correction(const JSONObject& json) :
     }
   }
 
+  edges_table_ = edges;
   data_ = resolve_content(json.getRequiredValue("data"), *this);
+  edges_table_ = nullptr;
   initialized_ = true;
 }
 
+detail::NonUniformBins Correction::edges(std::vector<double>&& edges) const {
+  if ( edges_table_ != nullptr ) return edges_table_->intern(std::move(edges));
+  return std::make_shared<const std::vector<double>>(std::move(edges));
+}
+
+Correction::Correction(const Correction& other, std::vector<Variable>&& inputs) :
+  name_(other.name_),
+  description_(other.description_),
+  version_(other.version_),
+  inputs_(std::move(inputs)),
+  output_(other.output_),
+  initialized_(false)
+{}
+
+EvaluationContext::EvaluationContext(bool count) :
+  count_(count),
+  arena_(std::make_unique<detail::ScratchArena>())
+{}
+
+EvaluationContext::~EvaluationContext() = default;
+
+EvaluationContext::Stats EvaluationContext::stats() const {
+  const size_t inputs = converted_.capacity() + updated_.capacity() + selected_.capacity();
+  return {evaluations_, entries_, arena_->capacity() + inputs * sizeof(InputValue)};
+}
+
+void EvaluationContext::release() {
+  arena_->clear();
+  std::vector<InputValue>().swap(converted_);
+  std::vector<InputValue>().swap(updated_);
+  std::vector<InputValue>().swap(selected_);
+}
+
 double Correction::evaluate(const std::vector<Variable::Type>& values) const {
+  // Per-thread scratch storage, nodes do not call back into a Correction
+  static thread_local EvaluationContext context;
+  return evaluate(values, context);
+}
+
+double Correction::evaluate(const std::vector<Variable::Type>& values, EvaluationContext& context) const {
+  context.converted_.assign(values.begin(), values.end());
+  return evaluate(context.converted_.data(), context.converted_.size(), context);
+}
+
+double Correction::evaluate(const InputValue * values, size_t size, EvaluationContext& context) const {
+  context.count(1);
+  return evaluate(values, size);
+}
+
+double Correction::evaluate(const InputValue * values, size_t size) const {
+  if ( ! initialized_ ) {
+    throw std::logic_error("Not initialized");
+  }
+  if ( size != inputs_.size() ) {
+    throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(size)
+          + ", expected " + std::to_string(inputs_.size()) + ")");
+  }
+  for (size_t i=0; i < inputs_.size(); ++i) {
+    inputs_[i].validate(values[i].type());
+  }
+  return evaluate_unchecked(values);
+}
+
+void Correction::check_signature(const Variable::VarType * types, size_t n) const {
+  if ( ! initialized_ ) {
+    throw std::logic_error("Not initialized");
+  }
+  if ( n != inputs_.size() ) {
+    throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(n)
+          + ", expected " + std::to_string(inputs_.size()) + ")");
+  }
+  for (size_t i=0; i < inputs_.size(); ++i) {
+    inputs_[i].validate(types[i]);
+  }
+}
+
+double Correction::evaluate_unchecked(const InputValue * values) const {
+  if ( cache_ ) {
+    return cache_->lookup(values, inputs_.size(), [&]() { return evaluate_uncached(values); });
+  }
+  return evaluate_uncached(values);
+}
+
+double Correction::evaluate_uncached(const InputValue * values) const {
+  return std::visit(node_evaluate{detail::InputView(values)}, data_);
+}
+
+void Correction::check_columns(const InputColumn * columns, size_t ncolumns) const {
   if ( ! initialized_ ) {
     throw std::logic_error("Not initialized");
   }
-  if ( values.size() != inputs_.size() ) {
-    throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(values.size())
+  if ( ncolumns != inputs_.size() ) {
+    throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(ncolumns)
           + ", expected " + std::to_string(inputs_.size()) + ")");
   }
   for (size_t i=0; i < inputs_.size(); ++i) {
-    inputs_[i].validate(values[i]);
+    inputs_[i].validate(columns[i].type());
+  }
+}
+
+void Correction::evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out) const {
+  check_columns(columns, ncolumns);
+  const detail::BatchView view(columns, ncolumns, size);
+  evaluate_view(view, out);
+  raise_failed(view, out);
+}
+
+void Correction::evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out,
+    EvaluationContext& context) const {
+  check_columns(columns, ncolumns);
+  context.count(size);
+  const detail::BatchView view(columns, ncolumns, size, nullptr, context.arena_.get());
+  evaluate_view(view, out);
+  raise_failed(view, out);
+}
+
+void Correction::evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, float * out) const {
+  check_columns(columns, ncolumns);
+  evaluate_narrowed(columns, ncolumns, size, out, [&](const InputColumn * block, size_t n, double * result) {
+    const detail::BatchView view(block, ncolumns, n);
+    evaluate_view(view, result);
+    raise_failed(view, result);
+  });
+}
+
+void Correction::evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out,
+    double fill, EntryStatus * status) const {
+  check_columns(columns, ncolumns);
+  evaluate_view(detail::BatchView(columns, ncolumns, size), out);
+  fill_failed(out, size, fill, status);
+}
+
+void Correction::evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, float * out,
+    double fill, EntryStatus * status) const {
+  check_columns(columns, ncolumns);
+  size_t start {0};
+  evaluate_narrowed(columns, ncolumns, size, out, [&](const InputColumn * block, size_t n, double * result) {
+    evaluate_view(detail::BatchView(block, ncolumns, n), result);
+    fill_failed(result, n, fill, ( status != nullptr ) ? status + start : nullptr);
+    start += n;
+  });
+}
+
+void Correction::evaluate_view(const detail::BatchView& view, double * out) const {
+  if ( cache_ ) {
+    // One entry at a time through the cache, which only the failures unwind.
+    // A failed entry is evaluated again as a batch of one, which marks it with
+    // its status; anything that is not a failure is raised as is.
+    std::vector<InputValue> row(view.ncolumns(), InputValue(0.));
+    std::vector<InputColumn> columns(view.ncolumns(), InputColumn(InputValue(0.)));
+    const auto failed = [&](size_t i) {
+      for (size_t j=0; j < row.size(); ++j) columns[j] = InputColumn(row[j]);
+      std::visit(node_evaluate_batch{detail::BatchView(columns.data(), columns.size(), 1), out + i}, data_);
+      return entry_status(out[i]) != EntryStatus::ok;
+    };
+    for (size_t i=0; i < view.size(); ++i) {
+      view.gather(i, row.data());
+      try {
+        out[i] = evaluate_unchecked(row.data());
+      }
+      catch (const std::logic_error&) { // category, or binning with wrap on NaN
+        if ( ! failed(i) ) throw;
+      }
+      catch (const std::runtime_error&) { // binning
+        if ( ! failed(i) ) throw;
+      }
+    }
+    return;
+  }
+  std::visit(node_evaluate_batch{view, out}, data_);
+}
+
+void Correction::raise_failed(const detail::BatchView& view, double * out) const {
+  std::vector<InputValue> row;
+  for (size_t i=0; i < view.size(); ++i) {
+    if ( entry_status(out[i]) == EntryStatus::ok ) continue;
+    row.resize(view.ncolumns(), InputValue(0.));
+    view.gather(i, row.data());
+    // raises, unless the result was a NaN that only looks like a failure
+    out[i] = evaluate_uncached(row.data());
+  }
+}
+
+void Correction::evaluate_variations(const std::string& input_name, const std::vector<std::string>& keys,
+    const InputColumn * columns, size_t ncolumns, size_t size, double * out) const {
+  if ( ! initialized_ ) {
+    throw std::logic_error("Not initialized");
+  }
+  const size_t idx = detail::find_input_index(input_name, inputs_);
+  if ( inputs_[idx].type() != Variable::VarType::string ) {
+    throw std::invalid_argument("Variations are only available for string inputs, got type "
+        + inputs_[idx].typeStr() + " for variable " + input_name);
+  }
+  if ( ncolumns + 1 != inputs_.size() ) {
+    throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(ncolumns)
+          + ", expected " + std::to_string(inputs_.size() - 1) + ")");
+  }
+  // the columns of all inputs, the key column is replaced for each key
+  std::vector<InputColumn> all;
+  all.reserve(inputs_.size());
+  for (size_t i=0; i < inputs_.size(); ++i) {
+    if ( i == idx ) {
+      all.push_back(InputColumn(InputValue(std::string_view())));
+      continue;
+    }
+    all.push_back(columns[( i < idx ) ? i : i - 1]);
+    inputs_[i].validate(all.back().type());
+  }
+  if ( keys.empty() ) return;
+  if ( cache_ ) {
+    for (size_t k=0; k < keys.size(); ++k) {
+      all[idx] = InputColumn(InputValue(std::string_view(keys[k])));
+      evaluate_batch(all.data(), all.size(), size, out + k*size);
+    }
+    return;
+  }
+  const detail::BatchView view(all.data(), all.size(), size);
+  const detail::VariationFanout fanout(idx, keys);
+  fanout.evaluate(std::vector<detail::VariationFanout::Branch>(keys.size(), detail::VariationFanout::branch(data_)), view, out, size);
+  for (size_t k=0; k < keys.size(); ++k) {
+    all[idx] = InputColumn(InputValue(std::string_view(keys[k])));
+    raise_failed(view, out + k*size);
+  }
+}
+
+void Correction::evaluate_grid(const InputColumn * axes, const size_t * sizes, size_t ncolumns, double * out) const {
+  check_columns(axes, ncolumns);
+  size_t total {1};
+  for (size_t j=0; j < ncolumns; ++j) total *= sizes[j];
+  if ( total == 0 ) return;
+
+  // the trailing axes from first on are expanded to columns of the block
+  // entries, which are evaluated for each point of the leading axes, as
+  // broadcast columns. The block is contiguous in out, and its columns are
+  // the same for every batch, so their bin indices are computed once
+  size_t first = ncolumns;
+  size_t block {1};
+  while ( first > 0 && ( first == ncolumns
+        || ( block < many_batch_block && block * sizes[first - 1] <= grid_max_block ) ) ) {
+    block *= sizes[--first];
+  }
+  std::vector<InputColumn> columns(axes, axes + ncolumns);
+  std::vector<std::vector<double>> reals(ncolumns);
+  std::vector<std::vector<int64_t>> integers(ncolumns);
+  std::vector<std::vector<std::string_view>> strings(ncolumns);
+  if ( first + 1 < ncolumns ) {
+    size_t inner {block};
+    for (size_t j=first; j < ncolumns; ++j) {
+      inner /= sizes[j];
+      const auto& axis = axes[j];
+      if ( axis.broadcast() ) continue;
+      switch ( axis.type() ) {
+        case Variable::VarType::real:
+          columns[j] = InputColumn(axis.single()
+              ? expand_axis(static_cast<const float*>(axis.data()), sizes[j], inner, block, reals[j])
+              : expand_axis(static_cast<const double*>(axis.data()), sizes[j], inner, block, reals[j]));
+          break;
+        case Variable::VarType::integer:
+          columns[j] = InputColumn(expand_axis(static_cast<const int64_t*>(axis.data()), sizes[j], inner, block, integers[j]));
+          break;
+        default:
+          columns[j] = InputColumn(expand_axis(static_cast<const std::string_view*>(axis.data()), sizes[j], inner, block, strings[j]));
+      }
+    }
+  }
+
+  detail::BinIndexCache bin_indices;
+  EvaluationContext context;
+  std::vector<size_t> point(first, 0); // on the leading axes, the last one fastest
+  for (size_t start=0; start < total; start += block) {
+    for (size_t j=0; j < first; ++j) columns[j] = InputColumn(axes[j][point[j]]);
+    const detail::BatchView view(columns.data(), ncolumns, block, &bin_indices, context.arena_.get());
+    evaluate_view(view, out + start);
+    raise_failed(view, out + start);
+    for (size_t j=first; j-- > 0; ) {
+      if ( ++point[j] < sizes[j] ) break;
+      point[j] = 0;
+    }
   }
-  return std::visit(node_evaluate{values}, data_);
+}
+
+Correction::Ref Correction::specialize(const std::map<std::string, Variable::Type>& values) const {
+  if ( ! initialized_ ) {
+    throw std::logic_error("Not initialized");
+  }
+  std::vector<std::optional<Variable::Type>> fixed(inputs_.size());
+  for (const auto& [name, value] : values) {
+    size_t idx = detail::find_input_index(name, inputs_);
+    inputs_[idx].validate(value);
+    fixed[idx] = value;
+  }
+  return specialize_inputs(std::move(fixed));
+}
+
+Correction::Ref Correction::cached(size_t capacity) const {
+  if ( ! initialized_ ) {
+    throw std::logic_error("Not initialized");
+  }
+  auto cache = std::make_shared<detail::EvaluationCache>(capacity);
+  auto out = specialize_inputs(std::vector<std::optional<Variable::Type>>(inputs_.size()));
+  out->cache_ = std::move(cache);
+  return out;
+}
+
+Correction::CacheStats Correction::cache_stats() const {
+  if ( ! cache_ ) return {0, 0, 0};
+  return {cache_->capacity(), cache_->hits(), cache_->misses()};
+}
+
+Correction::Ref Correction::tabulated(const TabulationOptions& options, std::vector<TabulationEntry> * report) const {
+  if ( ! initialized_ ) {
+    throw std::logic_error("Not initialized");
+  }
+  if ( ! (options.tolerance > 0.) ) {
+    throw std::invalid_argument("Tabulation tolerance must be positive");
+  }
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  detail::Tabulation tabulation{options, std::vector<std::pair<double, double>>(inputs_.size(), {-inf, inf}), report};
+  for (const auto& [name, range] : options.domains) {
+    size_t idx = detail::find_input_index(name, inputs_);
+    if ( inputs_[idx].type() != Variable::VarType::real ) {
+      throw std::invalid_argument("Tabulation domains are only for real inputs, got " + inputs_[idx].typeStr() + " for " + name);
+    }
+    if ( ! (range.first < range.second) || std::isinf(range.first) || std::isinf(range.second) ) {
+      throw std::invalid_argument("Invalid tabulation domain for input " + name);
+    }
+    tabulation.domain[idx] = range;
+  }
+  return specialize_inputs(std::vector<std::optional<Variable::Type>>(inputs_.size()), &tabulation);
+}
+
+Correction::Ref Correction::coalesced(size_t * removed) const {
+  if ( ! initialized_ ) {
+    throw std::logic_error("Not initialized");
+  }
+  size_t count {0};
+  auto out = specialize_inputs(std::vector<std::optional<Variable::Type>>(inputs_.size()), nullptr, &count);
+  if ( removed != nullptr ) *removed = count;
+  return out;
+}
+
+std::shared_ptr<Correction> Correction::specialize_inputs(std::vector<std::optional<Variable::Type>>&& fixed,
+    const detail::Tabulation * tabulation, size_t * coalesced) const {
+  std::vector<Variable> inputs;
+  std::vector<size_t> remap;
+  remap.reserve(inputs_.size());
+  for (size_t i=0; i < inputs_.size(); ++i) {
+    remap.push_back(inputs.size());
+    if ( ! fixed[i] ) inputs.push_back(inputs_[i]);
+  }
+
+  std::shared_ptr<Correction> out(new Correction(*this, std::move(inputs)));
+  const detail::Specialization spec{*this, *out, std::move(fixed), std::move(remap),
+    tabulation, tabulation ? tabulation->domain : std::vector<std::pair<double, double>>{}, coalesced};
+  for (const auto& formula : formula_refs_) {
+    out->formula_refs_.push_back(std::make_shared<Formula>(formula->specialize(spec)));
+  }
+  out->data_ = std::visit(node_specialize{spec}, data_);
+  out->initialized_ = true;
+  if ( cache_ ) {
+    // results differ once inputs are fixed, start afresh
+    out->cache_ = std::make_shared<detail::EvaluationCache>(cache_->capacity());
+  }
+  return out;
 }
 
 CompoundCorrection::CompoundCorrection(const JSONObject& json, const CorrectionSet& context) :
@@ -721,20 +2995,34 @@ size_t CompoundCorrection::input_index(const std::string_view name) const {
 }
 
 double CompoundCorrection::evaluate(const std::vector<Variable::Type>& values) const {
-  // Per-thread scratch storage. This call site is not re-entrant so we
-  // can use a simpler implementation than for TransformScratch
-  static thread_local std::vector<Variable::Type> ivalues;
-  static thread_local std::vector<Variable::Type> cvalues;
+  static thread_local EvaluationContext context;
+  return evaluate(values, context);
+}
 
-  if ( values.size() != inputs_.size() ) {
-    throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(values.size())
+double CompoundCorrection::evaluate(const std::vector<Variable::Type>& values, EvaluationContext& context) const {
+  context.converted_.assign(values.begin(), values.end());
+  return evaluate(context.converted_.data(), context.converted_.size(), context);
+}
+
+double CompoundCorrection::evaluate(const InputValue * values, size_t size) const {
+  // Per-thread scratch storage, this call site is not re-entrant
+  static thread_local EvaluationContext context;
+  return evaluate(values, size, context);
+}
+
+double CompoundCorrection::evaluate(const InputValue * values, size_t size, EvaluationContext& context) const {
+  std::vector<InputValue>& ivalues = context.updated_;
+  std::vector<InputValue>& cvalues = context.selected_;
+
+  if ( size != inputs_.size() ) {
+    throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(size)
           + ", expected " + std::to_string(inputs_.size()) + ")");
   }
   for (size_t i=0; i < inputs_.size(); ++i) {
-    inputs_[i].validate(values[i]);
+    inputs_[i].validate(values[i].type());
   }
-  ivalues = values;
-  cvalues.reserve(values.size());
+  ivalues.assign(values, values + size);
+  cvalues.reserve(size);
 
   double out = 0.;
   double sf = 0.;
@@ -742,12 +3030,12 @@ double CompoundCorrection::evaluate(const std::vector<Variable::Type>& values) c
   for(const auto& [inmap, corr] : stack_) {
     cvalues.clear();
     for(size_t pos : inmap) cvalues.push_back(ivalues[pos]);
-    sf = corr->evaluate(cvalues);
+    sf = corr->evaluate(cvalues.data(), cvalues.size(), context);
     for(size_t pos : inputs_update_) {
       switch ( input_op_ ) {
-        case UpdateOp::Add: std::get<double>(ivalues[pos]) += sf; break;
-        case UpdateOp::Multiply: std::get<double>(ivalues[pos]) *= sf; break;
-        case UpdateOp::Divide: std::get<double>(ivalues[pos]) /= sf; break;
+        case UpdateOp::Add: ivalues[pos] = ivalues[pos].real() + sf; break;
+        case UpdateOp::Multiply: ivalues[pos] = ivalues[pos].real() * sf; break;
+        case UpdateOp::Divide: ivalues[pos] = ivalues[pos].real() / sf; break;
         case UpdateOp::Last: throw std::logic_error("Illegal update op");
       }
     }
@@ -764,6 +3052,78 @@ double CompoundCorrection::evaluate(const std::vector<Variable::Type>& values) c
   return out;
 }
 
+void CompoundCorrection::evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out) const {
+  evaluate_columns(columns, ncolumns, size, out, nullptr);
+}
+
+void CompoundCorrection::evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, double * out,
+    EvaluationContext& context) const {
+  evaluate_columns(columns, ncolumns, size, out, &context);
+}
+
+void CompoundCorrection::evaluate_columns(const InputColumn * columns, size_t ncolumns, size_t size, double * out,
+    EvaluationContext * context) const {
+  if ( ncolumns != inputs_.size() ) {
+    throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(ncolumns)
+          + ", expected " + std::to_string(inputs_.size()) + ")");
+  }
+  for (size_t i=0; i < inputs_.size(); ++i) {
+    inputs_[i].validate(columns[i].type());
+  }
+
+  detail::ScratchArena * arena = ( context != nullptr ) ? context->arena_.get() : nullptr;
+
+  // the updated inputs get their own columns, the others are used as given
+  detail::ScratchBuffer<InputColumn> ivalues(arena, ncolumns);
+  std::uninitialized_copy(columns, columns + ncolumns, ivalues.begin());
+  detail::ScratchBuffer<double> updated(arena, inputs_update_.size() * size);
+  for (size_t i=0; i < inputs_update_.size(); ++i) {
+    const InputColumn& column = columns[inputs_update_[i]];
+    double * v = updated.data() + i * size;
+    for (size_t j=0; j < size; ++j) v[j] = column[j].real();
+    ivalues[inputs_update_[i]] = InputColumn(v);
+  }
+
+  size_t largest {0};
+  for(const auto& [inmap, corr] : stack_) largest = std::max(largest, inmap.size());
+  detail::ScratchBuffer<InputColumn> cvalues(arena, largest);
+  std::uninitialized_fill(cvalues.begin(), cvalues.end(), InputColumn(InputValue(0.)));
+  // the first output, or any output for Last, can be written in place
+  detail::ScratchBuffer<double> sfbuffer(arena, ( stack_.size() > 1 && output_op_ != UpdateOp::Last ) ? size : 0);
+  bool start{true};
+  for(const auto& [inmap, corr] : stack_) {
+    for (size_t k=0; k < inmap.size(); ++k) cvalues[k] = ivalues[inmap[k]];
+    double * sf = ( start || output_op_ == UpdateOp::Last ) ? out : sfbuffer.data();
+    if ( context != nullptr ) corr->evaluate_batch(cvalues.data(), inmap.size(), size, sf, *context);
+    else corr->evaluate_batch(cvalues.data(), inmap.size(), size, sf);
+    for (size_t i=0; i < inputs_update_.size(); ++i) {
+      double * v = updated.data() + i * size;
+      switch ( input_op_ ) {
+        case UpdateOp::Add: for (size_t j=0; j < size; ++j) v[j] += sf[j]; break;
+        case UpdateOp::Multiply: for (size_t j=0; j < size; ++j) v[j] *= sf[j]; break;
+        case UpdateOp::Divide: for (size_t j=0; j < size; ++j) v[j] /= sf[j]; break;
+        case UpdateOp::Last: throw std::logic_error("Illegal update op");
+      }
+    }
+    if ( sf != out ) {
+      switch ( output_op_ ) {
+        case UpdateOp::Add: for (size_t j=0; j < size; ++j) out[j] += sf[j]; break;
+        case UpdateOp::Multiply: for (size_t j=0; j < size; ++j) out[j] *= sf[j]; break;
+        case UpdateOp::Divide: for (size_t j=0; j < size; ++j) out[j] /= sf[j]; break;
+        case UpdateOp::Last: break; // written in place
+      }
+    }
+    start = false;
+  }
+  if ( start ) std::fill(out, out + size, 0.);
+}
+
+void CompoundCorrection::evaluate_batch(const InputColumn * columns, size_t ncolumns, size_t size, float * out) const {
+  evaluate_narrowed(columns, ncolumns, size, out, [&](const InputColumn * block, size_t n, double * result) {
+    evaluate_batch(block, ncolumns, n, result);
+  });
+}
+
 std::unique_ptr<CorrectionSet> CorrectionSet::from_file(const std::string& fn) {
   rapidjson::Document json;
   FILE* fp = fopen(fn.c_str(), "rb");
@@ -825,9 +3185,10 @@ CorrectionSet::CorrectionSet(const JSONObject& json) {
     throw std::runtime_error("Evaluator is designed for schema v" + std::to_string(evaluator_version) + " and is not backward-compatible");
   }
   description_ = json.getOptional<const char*>("description").value_or("");
+  detail::EdgesTable edges;
   for (const auto& item : json.getRequired<rapidjson::Value::ConstArray>("corrections")) {
     if ( ! item.IsObject() ) { throw std::runtime_error("Expected Correction object"); }
-    auto corr = std::make_shared<Correction>(item.GetObject());
+    std::shared_ptr<Correction> corr(new Correction(item.GetObject(), &edges));
     if ( corrections_.find(corr->name()) != corrections_.end() ) {
       throw std::runtime_error("Duplicate Correction name: " + corr->name());
     }
@@ -845,6 +3206,43 @@ CorrectionSet::CorrectionSet(const JSONObject& json) {
   }
 }
 
+void CorrectionSet::evaluate_many(const std::vector<std::string>& names, const std::vector<std::vector<InputColumn>>& columns, size_t size, double * out) const {
+  if ( columns.size() != names.size() ) {
+    throw std::invalid_argument("Inconsistent number of corrections and input column sets in evaluate_many");
+  }
+  std::vector<const Correction*> corrections;
+  corrections.reserve(names.size());
+  for (const auto& name : names) {
+    const auto it = corrections_.find(name);
+    if ( it == corrections_.end() ) {
+      throw std::out_of_range("No correction named " + name + " in CorrectionSet");
+    }
+    corrections.push_back(it->second.get());
+  }
+  // check all inputs before evaluating anything
+  std::vector<Variable::VarType> types;
+  for (size_t k=0; k < corrections.size(); ++k) {
+    types.clear();
+    for (const auto& column : columns[k]) types.push_back(column.type());
+    corrections[k]->check_signature(types.data(), types.size());
+  }
+
+  // the corrections of a block share the bin indices of their common inputs
+  detail::BinIndexCache bin_indices;
+  std::vector<InputColumn> block;
+  for (size_t start=0; start < size; start += many_batch_block) {
+    const size_t n = std::min(many_batch_block, size - start);
+    bin_indices.clear();
+    for (size_t k=0; k < corrections.size(); ++k) {
+      block.clear();
+      for (const auto& column : columns[k]) block.push_back(column.offset(start));
+      const detail::BatchView view(block.data(), block.size(), n, &bin_indices);
+      corrections[k]->evaluate_view(view, out + k * size + start);
+      corrections[k]->raise_failed(view, out + k * size + start);
+    }
+  }
+}
+
 bool CorrectionSet::validate() {
   // TODO: validate with https://rapidjson.org/md_doc_schema.html
   return true;
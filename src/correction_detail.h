@@ -10,7 +10,10 @@
 #include <rapidjson/document.h>
 #include <stdexcept>
 #include <optional>
+#include <set>
 #include <string_view>
+#include <algorithm>
+#include <cstddef>
 #include "correction.h"
 
 namespace correction {
@@ -81,6 +84,126 @@ std::string_view JSONObject::getRequired<std::string_view>(const char*) const;
 
 namespace detail {
   size_t find_input_index(const std::string_view name, const std::vector<Variable> &inputs);
+
+  // Inputs fixed by Correction::specialize, indexed as in the source correction.
+  // The free inputs keep their order; remap gives their index in the target.
+  struct Specialization {
+    const Correction& source;
+    const Correction& target;
+    std::vector<std::optional<Variable::Type>> values;
+    std::vector<size_t> remap;
+
+    // for Correction::tabulated, and the range of each input in the current
+    // branch, narrowed by the binnings above it
+    const Tabulation * tabulation = nullptr;
+    std::vector<std::pair<double, double>> domain;
+    // for Correction::coalesced, the number of edges removed so far
+    size_t * coalesced = nullptr;
+
+    bool fixed(size_t idx) const { return values[idx].has_value(); }
+    const Variable::Type& value(size_t idx) const { return *values[idx]; }
+  };
+
+  struct Tabulation {
+    const Correction::TabulationOptions& options;
+    std::vector<std::pair<double, double>> domain; // of each input, from options.domains
+    std::vector<Correction::TabulationEntry> * report; // may be null
+  };
+
+  // The non-uniform bin edges of the corrections of a CorrectionSet, filled
+  // while loading so that nodes binning on identical edges share one copy
+  class EdgesTable {
+    public:
+      NonUniformBins intern(std::vector<double>&& edges) {
+        return *edges_.insert(std::make_shared<const std::vector<double>>(std::move(edges))).first;
+      }
+
+    private:
+      struct Less {
+        bool operator()(const NonUniformBins& a, const NonUniformBins& b) const { return *a < *b; }
+      };
+      std::set<NonUniformBins, Less> edges_;
+  };
+
+  // Scratch memory of an EvaluationContext for batch evaluation: a stack of
+  // chunks, kept from one evaluation to the next. Buffers must be returned in
+  // the reverse order they were taken, which ScratchBuffer does.
+  class ScratchArena {
+    public:
+      struct Mark {
+        size_t chunk;
+        size_t offset;
+      };
+      Mark mark() const { return {current_, offset_}; }
+      void release(Mark mark) { current_ = mark.chunk; offset_ = mark.offset; }
+      void * allocate(size_t bytes) {
+        bytes = (bytes + alignment - 1) / alignment * alignment;
+        for (; current_ < chunks_.size(); ++current_, offset_ = 0) {
+          if ( offset_ + bytes <= chunks_[current_].size ) {
+            void * out = chunks_[current_].data.get() + offset_;
+            offset_ += bytes;
+            return out;
+          }
+        }
+        // each chunk at least doubles the capacity, so few are needed
+        const size_t size = std::max({bytes, min_chunk, capacity_});
+        chunks_.push_back({std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+        capacity_ += size;
+        current_ = chunks_.size() - 1;
+        offset_ = bytes;
+        return chunks_.back().data.get();
+      }
+      // bytes held by the chunks
+      size_t capacity() const { return capacity_; }
+      // frees the chunks, only while no buffer is in use
+      void clear() { chunks_.clear(); capacity_ = 0; current_ = 0; offset_ = 0; }
+
+    private:
+      static constexpr size_t alignment = alignof(std::max_align_t);
+      static constexpr size_t min_chunk = 1 << 16;
+      struct Chunk {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+      };
+      std::vector<Chunk> chunks_;
+      size_t capacity_ = 0;
+      size_t current_ = 0;
+      size_t offset_ = 0;
+  };
+
+  // n uninitialized values of type T for the duration of a scope, from the
+  // arena of a batch if it has one, or else from the heap
+  template<typename T>
+  class ScratchBuffer {
+    static_assert(std::is_trivially_destructible_v<T>, "scratch values are not destroyed");
+    public:
+      ScratchBuffer(ScratchArena * arena, size_t n) : arena_(arena), size_(n) {
+        if ( arena_ ) {
+          mark_ = arena_->mark();
+          data_ = static_cast<T*>(arena_->allocate(n * sizeof(T)));
+        }
+        else {
+          heap_.reset(new std::byte[n * sizeof(T)]);
+          data_ = reinterpret_cast<T*>(heap_.get());
+        }
+      }
+      ~ScratchBuffer() { if ( arena_ ) arena_->release(mark_); }
+      ScratchBuffer(const ScratchBuffer&) = delete;
+      ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+      T * data() { return data_; }
+      size_t size() const { return size_; }
+      T& operator[](size_t i) { return data_[i]; }
+      T * begin() { return data_; }
+      T * end() { return data_ + size_; }
+
+    private:
+      ScratchArena * arena_;
+      ScratchArena::Mark mark_ {0, 0};
+      std::unique_ptr<std::byte[]> heap_;
+      T * data_;
+      size_t size_;
+  };
 }
 
 } // namespace correction
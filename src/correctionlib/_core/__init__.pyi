@@ -1,4 +1,4 @@
-from typing import Any, Dict, Iterator, List, Type, TypeVar, Union
+from typing import Any, Dict, Iterator, List, Tuple, Type, TypeVar, Union
 
 import numpy
 
@@ -12,6 +12,12 @@ class Variable:
     @staticmethod
     def from_string(json: str) -> Variable: ...
 
+class EvaluationContext:
+    def __init__(self, count: bool = ...) -> None: ...
+    @property
+    def stats(self) -> Dict[str, int]: ...
+    def release(self) -> None: ...
+
 class CompoundCorrection:
     @property
     def name(self) -> str: ...
@@ -25,6 +31,14 @@ class CompoundCorrection:
     def evalv(
         self, *args: Union[numpy.ndarray[Any, Any], str, int, float]
     ) -> numpy.ndarray[Any, numpy.dtype[numpy.float64]]: ...
+    def evalv_float32(
+        self, *args: Union[numpy.ndarray[Any, Any], str, int, float]
+    ) -> numpy.ndarray[Any, numpy.dtype[numpy.float32]]: ...
+    def evalv_context(
+        self,
+        context: EvaluationContext,
+        *args: Union[numpy.ndarray[Any, Any], str, int, float],
+    ) -> numpy.ndarray[Any, numpy.dtype[numpy.float64]]: ...
 
 class Correction:
     @property
@@ -41,6 +55,47 @@ class Correction:
     def evalv(
         self, *args: Union[numpy.ndarray[Any, Any], str, int, float]
     ) -> numpy.ndarray[Any, numpy.dtype[numpy.float64]]: ...
+    def evalv_float32(
+        self, *args: Union[numpy.ndarray[Any, Any], str, int, float]
+    ) -> numpy.ndarray[Any, numpy.dtype[numpy.float32]]: ...
+    def evalv_context(
+        self,
+        context: EvaluationContext,
+        *args: Union[numpy.ndarray[Any, Any], str, int, float],
+    ) -> numpy.ndarray[Any, numpy.dtype[numpy.float64]]: ...
+    def evalv_status(
+        self, fill: float, *args: Union[numpy.ndarray[Any, Any], str, int, float]
+    ) -> Tuple[
+        numpy.ndarray[Any, numpy.dtype[numpy.float64]],
+        numpy.ndarray[Any, numpy.dtype[numpy.uint8]],
+    ]: ...
+    def evalv_status_float32(
+        self, fill: float, *args: Union[numpy.ndarray[Any, Any], str, int, float]
+    ) -> Tuple[
+        numpy.ndarray[Any, numpy.dtype[numpy.float32]],
+        numpy.ndarray[Any, numpy.dtype[numpy.uint8]],
+    ]: ...
+    def evaluate_variations(
+        self,
+        input_name: str,
+        keys: List[str],
+        *args: Union[numpy.ndarray[Any, Any], str, int, float],
+    ) -> numpy.ndarray[Any, numpy.dtype[numpy.float64]]: ...
+    def evaluate_grid(
+        self,
+        *args: Union[numpy.ndarray[Any, Any], List[str], str, int, float],
+    ) -> numpy.ndarray[Any, numpy.dtype[numpy.float64]]: ...
+    def specialize(self, values: Dict[str, Union[str, int, float]]) -> Correction: ...
+    def cached(self, capacity: int) -> Correction: ...
+    def tabulated(
+        self,
+        tolerance: float,
+        domains: Dict[str, Tuple[float, float]],
+        max_points: int = ...,
+    ) -> Tuple[Correction, List[Dict[str, Any]]]: ...
+    def coalesced(self) -> Tuple[Correction, int]: ...
+    @property
+    def cache_stats(self) -> Dict[str, int]: ...
 
 T = TypeVar("T", bound="CorrectionSet")
 
@@ -58,6 +113,10 @@ class CorrectionSet:
     def __iter__(self) -> Iterator[str]: ...
     @property
     def compound(self) -> Dict[str, CompoundCorrection]: ...
+    def evaluate_many(
+        self,
+        requests: Dict[str, Dict[str, Union[numpy.ndarray[Any, Any], str, int, float]]],
+    ) -> numpy.ndarray[Any, numpy.dtype[numpy.float64]]: ...
 
 class FormulaAst:
     class NodeType:
@@ -1,6 +1,7 @@
 """Command-line interface to correctionlib."""
 
 import argparse
+import json
 import sys
 
 import pydantic
@@ -199,6 +200,50 @@ def setup_config(subparsers):
     return parser
 
 
+def codegen(console: Console, args: argparse.Namespace) -> int:
+    from correctionlib.codegen import generate
+
+    cset = model_auto(open_auto(args.file))
+    if cset.schema_version != 2:
+        console.print("[red]Code generation requires schema version 2")
+        return 1
+    corr = next((corr for corr in cset.corrections if corr.name == args.name), None)
+    if corr is None:
+        console.print(f"[red]Correction {args.name!r} not found in {args.file}")
+        return 1
+    try:
+        code = generate(json.loads(corr.model_dump_json()), namespace=args.namespace)
+    except ValueError as ex:
+        console.print(f"[red]Cannot generate code for {args.name!r}: {ex}")
+        return 1
+    if args.output:
+        with open(args.output, "w") as fout:
+            fout.write(code)
+    else:
+        sys.stdout.write(code)
+    return 0
+
+
+def setup_codegen(subparsers):
+    parser = subparsers.add_parser(
+        "codegen",
+        help="Generate a standalone C++17 header that evaluates one correction",
+    )
+    parser.set_defaults(command=codegen)
+    parser.add_argument("--name", "-n", required=True, help="Correction to generate")
+    parser.add_argument(
+        "--namespace",
+        type=str,
+        default=None,
+        help="C++ namespace of the evaluate function (default: the correction name)",
+    )
+    parser.add_argument(
+        "--output", "-o", type=str, default=None, help="Output file (default: stdout)"
+    )
+    parser.add_argument("file", metavar="FILE")
+    return parser
+
+
 def main() -> int:
     parser = argparse.ArgumentParser(prog="correction", description=__doc__)
     parser.add_argument(
@@ -214,6 +259,7 @@ def main() -> int:
     all_commands.append(setup_summary(subparsers))
     all_commands.append(setup_merge(subparsers))
     all_commands.append(setup_config(subparsers))
+    all_commands.append(setup_codegen(subparsers))
     args = parser.parse_args()
 
     console = Console(width=args.width, record=bool(args.html))
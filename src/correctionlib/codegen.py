@@ -0,0 +1,472 @@
+"""Ahead-of-time C++ code generation for a correction
+
+`generate` translates the JSON representation of one correction into a
+standalone C++17 header, which only depends on the standard library. Bin
+edges and constant contents become ``constexpr`` arrays, formulas are parsed
+by the evaluator and their syntax tree becomes inline arithmetic, and
+categories become ``switch`` statements (over the position in a sorted key
+array for string keys). The correction is exposed as a plain ``evaluate``
+function with one typed argument per input.
+
+Each node follows the evaluation of the corresponding C++ node, so that the
+results are those of `correctionlib.Correction.evaluate`, including the flow
+behavior of binnings and the exceptions raised for out of range values and
+missing keys. Only math functions that the compiler evaluates at compile time
+or rewrites (such as ``pow(x, 2)`` as ``x*x``) may differ in the last bit.
+HashPRNG and LWTNN nodes are not supported.
+"""
+
+from __future__ import annotations
+
+import json
+import math
+import re
+from collections.abc import Sequence
+from typing import Any
+
+import correctionlib._core
+
+__all__ = ["generate"]
+
+_CXX_KEYWORDS = {
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor",
+    "bool", "break", "case", "catch", "char", "char16_t", "char32_t", "class",
+    "compl", "const", "constexpr", "const_cast", "continue", "decltype",
+    "default", "delete", "do", "double", "dynamic_cast", "else", "enum",
+    "explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+    "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+    "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private",
+    "protected", "public", "register", "reinterpret_cast", "return", "short",
+    "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+    "switch", "template", "this", "thread_local", "throw", "true", "try",
+    "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual",
+    "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+    # names used by the generated code, other than those with _PREFIX
+    "detail", "evaluate", "std",
+}  # fmt: skip
+
+# prefix of the locals and functions of the generated code, which identifier
+# never returns for an input name
+_PREFIX = "cl_"
+
+_PRELUDE = """\
+// Generated by `correction codegen` from correction {name!r} version {version}.
+// Do not edit, generate it again from the correction instead.
+//
+// The results are those of correctionlib's Correction::evaluate, up to the last
+// bit of math functions that the compiler may evaluate differently (such as
+// pow(x, 2) as x*x), when compiled without -ffast-math and with -ffp-contract=off
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {namespace} {{
+namespace detail {{
+
+[[noreturn]] inline void cl_out_of_bounds(double value, double low, const char * node, int variableIdx) {{
+  throw std::runtime_error(std::string("Index ") + (value < low ? "below" : "above") + " bounds in " + node
+      + " for input argument " + std::to_string(variableIdx) + " value: " + std::to_string(value));
+}}
+
+[[noreturn]] inline void cl_wrap_failed(double value, double low) {{
+  throw std::logic_error(value < low ? "I should not have ever seen an underflow" : "I should not have ever seen an overflow");
+}}
+
+[[noreturn]] inline void cl_missing_key(int variableIdx, const std::string& value) {{
+  throw std::out_of_range("Index not available in Category for input argument " + std::to_string(variableIdx) + " val: " + value);
+}}
+"""
+
+
+def identifier(name: str) -> str:
+    """A C++ identifier for a correction or input name"""
+    out = re.sub(r"\W", "_", name, flags=re.ASCII)
+    if not out or out[0].isdigit():
+        out = "_" + out
+    if out in _CXX_KEYWORDS:
+        out += "_"
+    if out.startswith(_PREFIX):
+        out = "_" + out
+    return out
+
+
+def _double(value: Any) -> str:
+    """A C++ literal for a double, read back as the same value"""
+    if isinstance(value, str):
+        if value in ("inf", "+inf"):
+            value = math.inf
+        elif value == "-inf":
+            value = -math.inf
+        else:
+            raise ValueError(f"Invalid edge {value!r}")
+    value = float(value)
+    if math.isnan(value):
+        return "std::numeric_limits<double>::quiet_NaN()"
+    if math.isinf(value):
+        return ("-" if value < 0 else "") + "std::numeric_limits<double>::infinity()"
+    out = repr(value)
+    if not any(c in out for c in ".e"):
+        out += "."
+    return out
+
+
+def _integer(value: int) -> str:
+    if value == -(2**63):
+        return "(-9223372036854775807LL - 1)"
+    return f"{value}LL"
+
+
+def _string(value: str) -> str:
+    """A std::string_view literal, with the length given for embedded NUL"""
+    data = value.encode("utf-8")
+    chars = []
+    for byte in data:
+        c = chr(byte)
+        if c in '"\\?' or not (0x20 <= byte < 0x7F):
+            chars.append(f"\\{byte:03o}")
+        else:
+            chars.append(c)
+    return f'std::string_view("{"".join(chars)}", {len(data)})'
+
+
+# FormulaAst binary operations written as C++ operators or functions
+_BINARY_OPERATORS = {
+    "LOGICALOR": "||", "LOGICALAND": "&&", "EQUAL": "==", "NOTEQUAL": "!=",
+    "GREATER": ">", "LESS": "<", "GREATEREQ": ">=", "LESSEQ": "<=",
+    "MINUS": "-", "PLUS": "+", "DIV": "/", "TIMES": "*",
+}  # fmt: skip
+_BINARY_FUNCTIONS = {
+    "POW": "std::pow", "ATAN2": "std::atan2", "MAX": "std::max", "MIN": "std::min"
+}  # fmt: skip
+
+
+class _Generator:
+    def __init__(self, corr: dict[str, Any]):
+        self.corr = corr
+        self.inputs: list[tuple[str, str, str]] = []  # name, type, identifier
+        seen = set()
+        for var in corr["inputs"]:
+            ident = identifier(var["name"])
+            while ident in seen:
+                ident += "_"
+            seen.add(ident)
+            self.inputs.append((var["name"], var["type"], ident))
+        self.variables = [
+            correctionlib._core.Variable.from_string(json.dumps(var))
+            for var in corr["inputs"]
+        ]
+        self.functions: list[str] = []
+        self.names: dict[int, str] = {}  # function of each node, by id
+        self.bodies: dict[str, str] = {}  # function of each body
+
+    # helpers over the inputs
+
+    def input_index(self, name: str) -> int:
+        for i, (iname, _, _) in enumerate(self.inputs):
+            if iname == name:
+                return i
+        raise ValueError(f"Variable {name!r} is not an input of the correction")
+
+    def signature(self) -> str:
+        ctypes = {"real": "double", "int": "std::int64_t", "string": "std::string_view"}
+        return ", ".join(
+            f"[[maybe_unused]] {ctypes[vtype]} {ident}"
+            for _, vtype, ident in self.inputs
+        )
+
+    def arguments(self, replace: dict[int, str] | None = None) -> list[str]:
+        args = [ident for _, _, ident in self.inputs]
+        for i, expr in (replace or {}).items():
+            args[i] = expr
+        return args
+
+    def number(self, name: str) -> tuple[int, str]:
+        """Index of a binning input and its value as a double"""
+        idx = self.input_index(name)
+        _, vtype, ident = self.inputs[idx]
+        if vtype == "string":
+            raise ValueError("Binning cannot use string inputs as binning variables")
+        return idx, (ident if vtype == "real" else f"static_cast<double>({ident})")
+
+    # nodes: each returns a C++ expression in terms of the arguments
+
+    def call(self, node: Any, args: list[str] | None = None) -> str:
+        if isinstance(node, (int, float)):
+            return _double(node)
+        name = self.function(node)
+        return f"{name}({', '.join(args or self.arguments())})"
+
+    def function(self, node: dict[str, Any]) -> str:
+        if id(node) in self.names:
+            return self.names[id(node)]
+        nodetype = node["nodetype"]
+        methods = {
+            "binning": self.binning,
+            "multibinning": self.multibinning,
+            "category": self.category,
+            "formula": self.formula,
+            "formularef": self.formularef,
+            "transform": self.transform,
+        }
+        if nodetype not in methods:
+            raise ValueError(f"{nodetype} nodes are not supported by codegen")
+        body = methods[nodetype](node)
+        # identical nodes, e.g. repeated formulas, share their function
+        if body not in self.bodies:
+            self.bodies[body] = f"{_PREFIX}node{len(self.functions)}"
+            self.functions.append(
+                f"inline double {self.bodies[body]}({self.signature()}) {{\n{body}}}\n"
+            )
+        self.names[id(node)] = self.bodies[body]
+        return self.bodies[body]
+
+    def table(self, contents: list[Any], index: str) -> str:
+        """The contents at position index, a constexpr array if all constants"""
+        if all(isinstance(item, (int, float)) for item in contents):
+            values = ", ".join(_double(item) for item in contents)
+            return (
+                f"  static constexpr double cl_values[] = {{{values}}};\n"
+                f"  return cl_values[{index}];\n"
+            )
+        lines = [f"  switch ({index}) {{\n"]
+        for i, item in enumerate(contents[:-1]):
+            lines.append(f"    case {i}: return {self.call(item)};\n")
+        lines.append(f"    default: return {self.call(contents[-1])};\n")
+        lines.append("  }\n")
+        return "".join(lines)
+
+    def bin_index(
+        self,
+        edges: Any,
+        flow: Any,
+        value: str,
+        variable_idx: int,
+        nodename: str,
+        target: str,
+    ) -> str:
+        """Assigns the bin index of value to target, as find_bin_idx does
+
+        Out of range values with a value flow get the number of bins.
+        """
+        out = f"  double cl_value = {value};\n"
+        if isinstance(edges, dict):  # uniform
+            n, low, high = edges["n"], _double(edges["low"]), _double(edges["high"])
+            index = f"static_cast<std::size_t>({n}. * cl_norm)"
+            out += f"  double cl_norm = ((cl_value - {low}) / ({high} - {low}));\n"
+            if flow == "wrap":
+                return out + (
+                    "  cl_norm -= std::floor(cl_norm);\n" f"  {target} = {index};\n"
+                )
+            out += f"  if ( cl_value < {low} || cl_value >= {high} ) {{\n"
+            if flow == "clamp":
+                out += f"    {target} = cl_value < {low} ? 0 : {n - 1};\n"
+            elif flow == "error":
+                out += f'    cl_out_of_bounds(cl_value, {low}, "{nodename}", {variable_idx});\n'
+            else:
+                out += f"    {target} = {n};\n"
+            return out + f"  }}\n  else {target} = {index};\n"
+
+        nedges = len(edges)
+        values = ", ".join(_double(edge) for edge in edges)
+        low, high = _double(edges[0]), _double(edges[-1])
+        out += f"  static constexpr double cl_edges[] = {{{values}}};\n"
+        if flow == "wrap":
+            out += (
+                f"  double cl_norm = (cl_value - {low}) / ({high} - {low});\n"
+                "  cl_norm -= std::floor(cl_norm);\n"
+                f"  cl_value = {low} + cl_norm * ({high} - {low});\n"
+            )
+        out += f"  const double * cl_it = std::upper_bound(cl_edges, cl_edges + {nedges}, cl_value);\n"
+        outside = f"cl_it == cl_edges || cl_it == cl_edges + {nedges}"
+        if flow == "clamp":
+            out += (
+                "  if ( cl_it == cl_edges ) ++cl_it;\n"
+                f"  else if ( cl_it == cl_edges + {nedges} ) --cl_it;\n"
+            )
+        elif flow == "error":
+            out += f'  if ( {outside} ) cl_out_of_bounds(cl_value, {low}, "{nodename}", {variable_idx});\n'
+        elif flow == "wrap":
+            out += f"  if ( {outside} ) cl_wrap_failed(cl_value, {low});\n"
+        else:  # the default value follows the last bin
+            out += f"  if ( {outside} ) cl_it = cl_edges + {nedges};\n"
+        return out + f"  {target} = std::distance(cl_edges, cl_it) - 1;\n"
+
+    def binning(self, node: dict[str, Any]) -> str:
+        variable_idx, value = self.number(node["input"])
+        flow = node["flow"]
+        contents = list(node["content"])
+        contents.append(flow if isinstance(flow, (int, float, dict)) else 0.0)
+        out = "  std::size_t cl_idx;\n"
+        out += self.bin_index(
+            node["edges"], flow, value, variable_idx, "Binning", "cl_idx"
+        )
+        return out + self.table(contents, "cl_idx")
+
+    def multibinning(self, node: dict[str, Any]) -> str:
+        flow = node["flow"]
+        contents = list(node["content"])
+        if isinstance(flow, (int, float, dict)):
+            contents.append(flow)
+        nbins = [
+            edges["n"] if isinstance(edges, dict) else len(edges) - 1
+            for edges in node["edges"]
+        ]
+        strides = [math.prod(nbins[i + 1 :]) for i in range(len(nbins))]
+        out = "  std::size_t cl_idx = 0;\n"
+        for name, edges, n, stride in zip(
+            node["inputs"], node["edges"], nbins, strides
+        ):
+            variable_idx, value = self.number(name)
+            axis = "  std::size_t cl_local;\n"
+            axis += self.bin_index(
+                edges, flow, value, variable_idx, "MultiBinning", "cl_local"
+            )
+            axis += f"  if ( cl_local == {n} ) return {self.call(contents[-1])};\n"
+            axis += f"  cl_idx += cl_local * {stride};\n"
+            out += (
+                "  {\n"
+                + "".join("  " + line + "\n" for line in axis.splitlines())
+                + "  }\n"
+            )
+        return out + self.table(contents, "cl_idx")
+
+    def category(self, node: dict[str, Any]) -> str:
+        variable_idx = self.input_index(node["input"])
+        _, vtype, ident = self.inputs[variable_idx]
+        keys: list[Any] = []
+        values: list[Any] = []
+        seen = set()
+        for item in node["content"]:
+            if item["key"] not in seen:  # the first occurrence wins
+                seen.add(item["key"])
+                keys.append(item["key"])
+                values.append(item["value"])
+        if "default" in node and node["default"] is not None:
+            default = f"return {self.call(node['default'])}"
+        elif vtype == "string":
+            default = f"cl_missing_key({variable_idx}, std::string({ident}))"
+        else:
+            default = f"cl_missing_key({variable_idx}, std::to_string({ident}))"
+
+        if vtype == "int":
+            if not all(isinstance(key, int) for key in keys):
+                raise ValueError(
+                    "Category got a key of type string, but its input is type int"
+                )
+            lines = [f"  switch ({ident}) {{\n"]
+            for key, value in zip(keys, values):
+                lines.append(f"    case {_integer(key)}: return {self.call(value)};\n")
+            lines.append(f"    default: {default};\n  }}\n")
+            return "".join(lines)
+        if vtype != "string" or not all(isinstance(key, str) for key in keys):
+            raise ValueError(f"Category keys do not match its input of type {vtype}")
+        # the position in the keys sorted as std::string_view compares them
+        order = sorted(range(len(keys)), key=lambda i: keys[i].encode("utf-8"))
+        lines = [
+            "  static constexpr std::string_view cl_keys[] = {"
+            + ", ".join(_string(keys[i]) for i in order)
+            + "};\n",
+            f"  const auto cl_it = std::lower_bound(std::begin(cl_keys), std::end(cl_keys), {ident});\n",
+            f"  const std::size_t cl_pos = ( cl_it != std::end(cl_keys) && *cl_it == {ident} ) ? cl_it - std::begin(cl_keys) : {len(keys)};\n",
+            "  switch (cl_pos) {\n",
+        ]
+        for pos, i in enumerate(order):
+            lines.append(f"    case {pos}: return {self.call(values[i])};\n")
+        lines.append(f"    default: {default};\n  }}\n")
+        return "".join(lines)
+
+    def formula_expression(
+        self, formula: dict[str, Any], parameters: Sequence[float]
+    ) -> str:
+        # parsed by the evaluator, with the parameters bound as literals
+        spec = {key: formula[key] for key in ("expression", "parser", "variables")}
+        spec["parameters"] = list(parameters)
+        try:
+            ast = correctionlib._core.Formula.from_string(
+                json.dumps(spec), self.variables
+            ).ast
+        except RuntimeError as ex:
+            raise ValueError(str(ex)) from ex
+        return self.formula_ast(ast)
+
+    def formula_ast(self, ast: Any) -> str:
+        """A C++ expression that evaluates as FormulaAst::evaluate does"""
+        nodetype = ast.nodetype.name
+        if nodetype == "LITERAL":
+            out = _double(ast.data)
+            return f"({out})" if out.startswith("-") else out
+        if nodetype == "VARIABLE":
+            return self.inputs[ast.data][2]
+        args = [self.formula_ast(child) for child in ast.children]
+        if nodetype == "UNARY":
+            if ast.data.name == "NEGATIVE":
+                return f"(-{args[0]})"
+            return f"std::{ast.data.name.lower()}({args[0]})"
+        if nodetype != "BINARY":
+            raise ValueError(f"Unexpected {nodetype} node in formula")
+        left, right = args
+        op = ast.data.name
+        if op in _BINARY_FUNCTIONS:
+            return f"{_BINARY_FUNCTIONS[op]}({left}, {right})"
+        op = _BINARY_OPERATORS[op]
+        if op in ("||", "&&"):
+            return f"((({left} != 0.) {op} ({right} != 0.)) ? 1. : 0.)"
+        if op in ("==", "!=", ">", "<", ">=", "<="):
+            return f"(({left} {op} {right}) ? 1. : 0.)"
+        return f"({left} {op} {right})"
+
+    def formula(self, node: dict[str, Any]) -> str:
+        expr = self.formula_expression(node, node.get("parameters") or [])
+        return f"  return {expr};\n"
+
+    def formularef(self, node: dict[str, Any]) -> str:
+        formula = self.corr["generic_formulas"][node["index"]]
+        expr = self.formula_expression(formula, node["parameters"])
+        return f"  return {expr};\n"
+
+    def transform(self, node: dict[str, Any]) -> str:
+        variable_idx = self.input_index(node["input"])
+        _, vtype, _ = self.inputs[variable_idx]
+        if vtype == "string":
+            raise ValueError("Transform cannot rewrite string inputs")
+        out = f"  const double cl_vnew = {self.call(node['rule'])};\n"
+        vnew = (
+            "cl_vnew"
+            if vtype == "real"
+            else "static_cast<std::int64_t>(std::round(cl_vnew))"
+        )
+        content = self.call(node["content"], self.arguments({variable_idx: vnew}))
+        return out + f"  return {content};\n"
+
+
+def generate(corr: dict[str, Any], namespace: str | None = None) -> str:
+    """Generate a C++17 header that evaluates a correction
+
+    corr is the JSON representation of a schema v2 correction, as a dict.
+    The correction is evaluated by ``<namespace>::evaluate``, the namespace
+    defaulting to the correction name.
+    """
+    if corr["output"]["type"] != "real":
+        raise ValueError("Only real-valued corrections are supported")
+    gen = _Generator(corr)
+    root = gen.call(corr["data"], gen.arguments())
+    namespace = namespace or identifier(corr["name"])
+    out = [
+        _PRELUDE.format(name=corr["name"], version=corr["version"], namespace=namespace)
+    ]
+    out.extend("\n" + function for function in gen.functions)
+    out.append(f"\n}} // namespace detail\n\n")
+    description = corr.get("description")
+    if description:
+        out.extend(f"// {line}\n" for line in description.splitlines())
+    out.append(f"inline double evaluate({gen.signature()}) {{\n")
+    out.append(f"  using namespace detail;\n  return {root};\n}}\n\n")
+    out.append(f"}} // namespace {namespace}\n")
+    return "".join(out)
@@ -3,7 +3,7 @@
 from __future__ import annotations
 
 import json
-from collections.abc import Iterator, Mapping
+from collections.abc import Iterator, Mapping, Sequence
 from numbers import Integral
 from typing import TYPE_CHECKING, Any, Callable
 
@@ -94,10 +94,15 @@ def _call_as_numpy(
                 repacked_args[arg_indices[i]] = non_array_args[i - array_args_len]
 
         out = func(*repacked_args)
-        out = awkward.contents.NumpyArray(out.reshape(oshape))
-        if awkward.backend(*array_args) == "typetracer":
-            out = out.to_typetracer(forget_length=True)
-        return out
+        layouts = []
+        for result in out if isinstance(out, tuple) else (out,):
+            layout = awkward.contents.NumpyArray(
+                result.reshape(oshape + result.shape[1:])
+            )
+            if awkward.backend(*array_args) == "typetracer":
+                layout = layout.to_typetracer(forget_length=True)
+            layouts.append(layout)
+        return tuple(layouts) if isinstance(out, tuple) else layouts[0]
     return None
 
 
@@ -140,7 +145,7 @@ def _call_dask_correction(
     correction: Any,
     *args: numpy.ndarray[Any, Any] | str | int | float,
 ):
-    return _wrap_awkward(correction._base.evalv, *args)
+    return _wrap_awkward(_evalv(correction), *args)
 
 
 def _wrap_dask_awkward(
@@ -166,7 +171,7 @@ def _wrap_dask_awkward(
         )
 
     correction_meta = _wrap_awkward(
-        correction._base.evalv,
+        _evalv(correction),
         *(arg._meta if isinstance(arg, dask_awkward.Array) else arg for arg in args),
     )
 
@@ -187,11 +192,41 @@ def _isinstance(arg: Any, clsprefix: str) -> bool:
     return str(type(arg)).startswith(f"<class '{clsprefix}.")
 
 
+def _evalv_fill(
+    evalv_status: Callable[..., Any],
+    fill: float,
+    *args: numpy.ndarray[Any, Any] | str | int | float,
+) -> numpy.ndarray[Any, Any]:
+    return evalv_status(fill, *args)[0]  # type: ignore
+
+
+def _evalv_status(corr: Correction) -> Callable[..., Any]:
+    """The non-raising array evaluation function of corr, with the output type of its set"""
+    if corr._context._dtype == numpy.float32:
+        return corr._base.evalv_status_float32
+    return corr._base.evalv_status
+
+
+def _evalv(
+    corr: Correction | CompoundCorrection, fill: float | None = None
+) -> Callable[..., Any]:
+    """The array evaluation function of corr, with the output type of its set"""
+    if fill is not None:
+        from functools import partial
+
+        return partial(_evalv_fill, _evalv_status(corr), fill)  # type: ignore
+    if corr._context._dtype == numpy.float32:
+        return corr._base.evalv_float32
+    return corr._base.evalv
+
+
 def _evaluate(
     corr: Correction | CompoundCorrection,
     *args: awkward.Array | numpy.ndarray[Any, Any] | str | int | float,
+    fill: float | None = None,
 ) -> float | awkward.Array | numpy.ndarray[Any, numpy.dtype[numpy.float64]]:
     # TODO: create a ufunc with numpy.vectorize in constructor?
+    evalv = _evalv(corr, fill)
     if any(_isinstance(arg, "dask.array") for arg in args):
         raise TypeError(
             "Correctionlib does not yet handle dask.array collections. "
@@ -200,27 +235,56 @@ def _evaluate(
             "issue at https://github.com/cms-nanoAOD/correctionlib/issues."
         )
     if any(_isinstance(arg, "dask_awkward") for arg in args):
+        if fill is not None:
+            raise NotImplementedError(
+                "Only errors='raise' is supported for dask_awkward arrays"
+            )
         return _wrap_dask_awkward(corr, *args)  # type: ignore
     if any(_isinstance(arg, "awkward") for arg in args):
-        return _wrap_awkward(corr._base.evalv, *args)  # type: ignore
+        return _wrap_awkward(evalv, *args)  # type: ignore
     if all(isinstance(arg, (str, int, float)) for arg in args):
+        if fill is not None:
+            return float(evalv(*args)[0])
         return corr._base.evaluate(*args)  # type: ignore
 
     # everything else: convert to numpy and broadcast
+    return _call_flat(evalv, *args)  # type: ignore
+
+
+def _call_flat(
+    func: Callable[..., Any],
+    *args: numpy.ndarray[Any, Any] | str | int | float,
+) -> Any:
+    """Call func with the array arguments broadcast together and flattened
+
+    func returns an array with a leading axis over the entries, or a tuple of
+    them, which are reshaped to the broadcast shape of the arguments.
+    """
     vargs = [
         numpy.asarray(arg) for arg in args if not isinstance(arg, (str, int, float))
     ]
-    assert vargs, "should have caught all-scalar case above"
     bargs = numpy.broadcast_arrays(*vargs)
-    oshape = bargs[0].shape
+    oshape = bargs[0].shape if bargs else ()
     fargs = (arg.flatten() for arg in bargs)
-    out = corr._base.evalv(
+    out = func(
         *(
             next(fargs) if not isinstance(arg, (str, int, float)) else arg
             for arg in args
         )
     )
-    return out.reshape(oshape)
+    if isinstance(out, tuple):
+        return tuple(result.reshape(oshape + result.shape[1:]) for result in out)
+    return out.reshape(oshape + out.shape[1:])
+
+
+def _apply(
+    func: Callable[..., Any],
+    *args: awkward.Array | numpy.ndarray[Any, Any] | str | int | float,
+) -> Any:
+    """As _call_flat, for awkward arrays as well"""
+    if any(_isinstance(arg, "awkward") for arg in args):
+        return _wrap_awkward(func, *args)
+    return _call_flat(func, *args)  # type: ignore
 
 
 class Correction:
@@ -230,18 +294,40 @@ class Correction:
     a CorrectionSet object, rather than directly by construction.
     """
 
-    def __init__(self, base: correctionlib._core.Correction, context: CorrectionSet):
+    def __init__(
+        self,
+        base: correctionlib._core.Correction,
+        context: CorrectionSet,
+        transforms: list[tuple[str, tuple[Any, ...]]] | None = None,
+    ):
         self._base = base
         self._name = base.name
         self._context = context
+        # the methods of the base correction that made this one, with their
+        # arguments, in the order they were applied
+        self._transforms = transforms or []
+
+    def _transformed(
+        self, base: correctionlib._core.Correction, method: str, *args: Any
+    ) -> Correction:
+        return Correction(base, self._context, [*self._transforms, (method, args)])
 
     def __getstate__(self) -> dict[str, Any]:
-        return {"_context": self._context, "_name": self._name}
+        return {
+            "_context": self._context,
+            "_name": self._name,
+            "_transforms": self._transforms,
+        }
 
     def __setstate__(self, state: dict[str, Any]) -> None:
         self._context = state["_context"]
         self._name = state["_name"]
+        self._transforms = state.get("_transforms", [])
         self._base = self._context[self._name]._base
+        for method, args in self._transforms:
+            out = getattr(self._base, method)(*args)
+            # some also return a report
+            self._base = out[0] if isinstance(out, tuple) else out
 
     @property
     def name(self) -> str:
@@ -264,9 +350,167 @@ class Correction:
         return self._base.output
 
     def evaluate(
-        self, *args: awkward.Array | numpy.ndarray[Any, Any] | str | int | float
+        self,
+        *args: awkward.Array | numpy.ndarray[Any, Any] | str | int | float,
+        errors: str | float = "raise",
     ) -> float | awkward.Array | numpy.ndarray[Any, numpy.dtype[numpy.float64]]:
-        return _evaluate(self, *args)
+        """Evaluate the correction
+
+        With ``errors="raise"`` (the default), an input out of the range of a
+        binning with ``flow="error"`` or a missing category key raises. With
+        ``errors="nan"`` or a number, the entries that cannot be evaluated
+        take that value instead and the others are evaluated as usual.
+        """
+        if isinstance(errors, str):
+            if errors == "raise":
+                return _evaluate(self, *args)
+            if errors != "nan":
+                raise ValueError(f"Unknown errors policy {errors!r}")
+            return _evaluate(self, *args, fill=numpy.nan)
+        return _evaluate(self, *args, fill=float(errors))
+
+    def evaluate_status(
+        self,
+        *args: awkward.Array | numpy.ndarray[Any, Any] | str | int | float,
+        fill: float = numpy.nan,
+    ) -> tuple[
+        awkward.Array | numpy.ndarray[Any, numpy.dtype[numpy.float64]],
+        awkward.Array | numpy.ndarray[Any, numpy.dtype[numpy.uint8]],
+    ]:
+        """Evaluate the correction without raising for entries that cannot be evaluated
+
+        Returns the values, with ``fill`` for those entries, and a status array
+        of the same shape: 0 if the entry was evaluated, 1 if an input was out of
+        the range of a binning, 2 if a category key was missing.
+        """
+        from functools import partial
+
+        return _apply(partial(_evalv_status(self), float(fill)), *args)  # type: ignore
+
+    def evaluate_variations(
+        self,
+        input_name: str,
+        keys: list[str],
+        *args: awkward.Array | numpy.ndarray[Any, Any] | str | int | float,
+    ) -> awkward.Array | numpy.ndarray[Any, numpy.dtype[numpy.float64]]:
+        """Evaluate the correction for several values of a string input
+
+        ``args`` are the other inputs, in order. Returns an array with a leading
+        axis over ``keys``, the values of ``input_name`` (e.g. the names of
+        systematic variations), or for awkward arrays an innermost one. Bin
+        lookups that are the same for all keys are done once per entry.
+        """
+        dtype = self._context._dtype
+
+        def evaluate(*cargs: Any) -> numpy.ndarray[Any, Any]:
+            out = self._base.evaluate_variations(input_name, list(keys), *cargs)
+            # with the axis over the entries first
+            return out.astype(dtype, copy=False).T
+
+        if any(_isinstance(arg, "awkward") for arg in args):
+            return _wrap_awkward(evaluate, *args)
+        return numpy.moveaxis(_call_flat(evaluate, *args), -1, 0)
+
+    def tabulate(
+        self,
+        points: Mapping[
+            str,
+            numpy.ndarray[Any, Any] | Sequence[str | int | float] | str | int | float,
+        ],
+    ) -> numpy.ndarray[Any, numpy.dtype[numpy.float64]]:
+        """Evaluate the correction on the outer product of points per input
+
+        ``points`` maps every input, by name, to a sequence of values (e.g. bin
+        edges or centers, or systematic names) or to a single value. Returns an
+        array with one axis per sequence, in the order of ``points``: for
+        ``{"eta": eta, "pt": pt, "syst": "nominal"}``, ``out[i, j]`` is the
+        correction at ``eta[i]``, ``pt[j]``. The grid is evaluated in batches,
+        without building arrays of all the combinations of the inputs.
+        """
+        names = [var.name for var in self.inputs]
+        missing = [name for name in names if name not in points]
+        if missing:
+            raise ValueError(f"Missing points for inputs {missing}")
+        unknown = [name for name in points if name not in names]
+        if unknown:
+            raise ValueError(f"Unknown inputs {unknown}")
+        scalar = {"real": float, "int": int, "string": str}
+        args: list[Any] = []
+        for var in self.inputs:
+            value = points[var.name]
+            if numpy.ndim(value) == 0:
+                args.append(scalar[var.type](value))
+            elif var.type == "string":
+                args.append([str(v) for v in value])
+            else:
+                args.append(numpy.asarray(value))
+        out = self._base.evaluate_grid(*args)
+        out = out.astype(self._context._dtype, copy=False)
+        # the axes come in the order of the inputs
+        axes = [name for name in names if numpy.ndim(points[name]) != 0]
+        return out.transpose([axes.index(name) for name in points if name in axes])
+
+    def specialize(self, values: Mapping[str, str | int | float]) -> Correction:
+        """Fix some inputs, by name, to constant values
+
+        Returns a new correction without those inputs, in which the nodes that
+        only depend on them are resolved ahead of time. This is useful when
+        inputs such as a systematic name or working point are the same for every call.
+        """
+        base = self._base.specialize(dict(values))
+        return self._transformed(base, "specialize", dict(values))
+
+    def cached(self, capacity: int) -> Correction:
+        """Remember recent results, keyed on the exact input values
+
+        Returns a new correction that keeps up to ``capacity`` results per thread.
+        Results are unchanged, but repeated inputs skip evaluation, which helps
+        for expensive nodes (neural networks, long formulas) evaluated on inputs
+        that repeat, e.g. per-event quantities broadcast to every jet.
+        """
+        return self._transformed(self._base.cached(capacity), "cached", capacity)
+
+    def tabulated(
+        self,
+        tolerance: float,
+        domains: Mapping[str, tuple[float, float]],
+        max_points: int = 65536,
+    ) -> tuple[Correction, list[dict[str, Any]]]:
+        """Replace smooth nodes by interpolation tables, within a tolerance
+
+        Formulas and neural networks of one or two real inputs are sampled on a
+        uniform grid over ``domains`` (the ``(low, high)`` range of real inputs,
+        by name), narrowed by the bins they are in. A node is replaced by linear
+        interpolation on its grid when the absolute error on a denser check
+        sample is at most ``tolerance``, with up to ``max_points`` grid points.
+        Values outside the grid are evaluated exactly.
+
+        Returns the new correction and a report with one entry per candidate
+        node: its inputs and domain, the grid points and memory in bytes of the
+        finest table tried, its error on the check sample, and whether it is used.
+        """
+        base, report = self._base.tabulated(tolerance, dict(domains), max_points)
+        return (
+            self._transformed(base, "tabulated", tolerance, dict(domains), max_points),
+            report,
+        )
+
+    def coalesced(self) -> tuple[Correction, int]:
+        """Merge adjacent bins with identical contents
+
+        Returns a new correction in which runs of adjacent bins holding the
+        same constant (or the same subtree) are one bin, and the number of bin
+        edges removed. Only inner edges of non-uniform binnings are removed, so
+        results, including the flow behavior, are unchanged, while lookups
+        search fewer edges.
+        """
+        base, removed = self._base.coalesced()
+        return self._transformed(base, "coalesced"), removed
+
+    @property
+    def cache_stats(self) -> dict[str, int]:
+        """Capacity (zero if not cached), hits, and misses, summed over threads"""
+        return self._base.cache_stats
 
 
 class CompoundCorrection:
@@ -340,28 +584,38 @@ class CorrectionSet(Mapping[str, Correction]):
     schema version, or can be initialized via the ``from_file`` or
     ``from_string`` factory methods. Corrections can be accessed
     via getitem syntax, e.g. ``cset["some correction"]``.
+
+    With ``dtype=numpy.float32``, array results are returned in single
+    precision. The evaluation itself is always done in double precision,
+    and ``float32`` input arrays are read as they are, without a conversion
+    to ``float64`` first. See ``float32_report`` for the bin edges that
+    ``float32`` inputs cannot represent.
     """
 
-    def __init__(self, data: Any):
+    def __init__(self, data: Any, dtype: Any = numpy.float64):
         if isinstance(data, str):
             self._data = data
         else:
             self._data = data.model_dump_json(exclude_unset=True)
+        self._dtype = numpy.dtype(dtype)
+        if self._dtype not in (numpy.float32, numpy.float64):
+            raise ValueError(f"Unsupported output dtype {self._dtype}")
         self._base = correctionlib._core.CorrectionSet.from_string(self._data)
 
     @classmethod
-    def from_file(cls, filename: str) -> CorrectionSet:
-        return cls(open_auto(filename))
+    def from_file(cls, filename: str, dtype: Any = numpy.float64) -> CorrectionSet:
+        return cls(open_auto(filename), dtype)
 
     @classmethod
-    def from_string(cls, data: str) -> CorrectionSet:
-        return cls(data)
+    def from_string(cls, data: str, dtype: Any = numpy.float64) -> CorrectionSet:
+        return cls(data, dtype)
 
     def __getstate__(self) -> dict[str, Any]:
-        return {"_data": self._data}
+        return {"_data": self._data, "_dtype": self._dtype.str}
 
     def __setstate__(self, state: dict[str, Any]) -> None:
         self._data = state["_data"]
+        self._dtype = numpy.dtype(state.get("_dtype", numpy.float64))
         self._base = correctionlib._core.CorrectionSet.from_string(self._data)
 
     def _ipython_key_completions_(self) -> list[str]:
@@ -384,3 +638,97 @@ class CorrectionSet(Mapping[str, Correction]):
     @property
     def compound(self) -> _CompoundMap:
         return _CompoundMap(self._base.compound, self)
+
+    def float32_report(self) -> list[dict[str, Any]]:
+        """Bin edges that are not exactly representable in single precision
+
+        A ``float32`` input written as such an edge (e.g. ``2.4``) is rounded to
+        a nearby value, which may fall into the neighbouring bin. Returns one
+        entry per edge, with the correction name, the input name, the edge and
+        its nearest ``float32`` value. For uniform binnings, only the low and
+        high edges are checked: the inner edges are not stored, the bin is
+        computed from the position of the input between them.
+        """
+        report: list[dict[str, Any]] = []
+
+        def edges(spec: Any) -> list[float]:
+            if isinstance(spec, dict):  # uniform
+                return [spec["low"], spec["high"]]
+            return list(spec)
+
+        def visit(node: Any, name: str) -> None:
+            if isinstance(node, list):
+                for item in node:
+                    visit(item, name)
+                return
+            if not isinstance(node, dict):
+                return
+            axes = []
+            if node.get("nodetype") == "binning":
+                axes = [(node["input"], node["edges"])]
+            elif node.get("nodetype") == "multibinning":
+                axes = list(zip(node["inputs"], node["edges"]))
+            for var, spec in axes:
+                for edge in edges(spec):
+                    single = float(numpy.float32(edge))
+                    if single != edge:
+                        report.append(
+                            {
+                                "correction": name,
+                                "input": var,
+                                "edge": edge,
+                                "float32": single,
+                            }
+                        )
+            for key, value in node.items():
+                if key != "edges":
+                    visit(value, name)
+
+        for corr in json.loads(self._data)["corrections"]:
+            visit(corr["data"], corr["name"])
+        return report
+
+    def evaluate_many(
+        self,
+        requests: Mapping[str, Mapping[str, Any]],
+        stack: bool = False,
+    ) -> (
+        dict[str, numpy.ndarray[Any, numpy.dtype[numpy.float64]]]
+        | numpy.ndarray[Any, numpy.dtype[numpy.float64]]
+    ):
+        """Evaluate several corrections over shared inputs in one call
+
+        ``requests`` maps correction names to their arguments by input name, e.g.
+        ``{"jec": {"pt": pt, "eta": eta}, "btag": columns}``. Extra arguments are
+        ignored, so that one mapping of columns can serve all corrections. Array
+        arguments are broadcast together, and an array used by several
+        corrections is converted only once. The corrections are then evaluated
+        together, one block of entries at a time.
+
+        Returns a dict of arrays by correction name or, with ``stack=True``, one
+        array with a leading axis over the corrections, in request order.
+        """
+        arrays: dict[int, numpy.ndarray[Any, Any]] = {}
+        for name, args in requests.items():
+            for var in self._base[name].inputs:
+                arg = args[var.name]
+                if not isinstance(arg, (str, int, float)) and id(arg) not in arrays:
+                    arrays[id(arg)] = numpy.asarray(arg)
+        oshape: tuple[int, ...] = ()
+        if arrays:
+            bargs = numpy.broadcast_arrays(*arrays.values())
+            oshape = bargs[0].shape
+            arrays = {key: arg.flatten() for key, arg in zip(arrays, bargs)}
+        out = self._base.evaluate_many(
+            {
+                name: {
+                    var.name: arrays.get(id(args[var.name]), args[var.name])
+                    for var in self._base[name].inputs
+                }
+                for name, args in requests.items()
+            }
+        )
+        out = out.astype(self._dtype, copy=False).reshape((len(requests),) + oshape)
+        if stack:
+            return out
+        return dict(zip(requests, out))
@@ -1,10 +1,12 @@
 #include <mutex>
 #include <cmath>
+#include <algorithm>
 #include <cstdlib> // std::abort
 #include <charconv> // std::from_chars
 #include <iomanip> // std::quoted
 #include "peglib.h"
 #include "correction.h"
+#include "correction_detail.h"
 
 using namespace correction;
 
@@ -233,11 +235,16 @@ FormulaAst FormulaAst::parse(
 }
 
 double FormulaAst::evaluate(const std::vector<Variable::Type>& values, const std::vector<double>& params) const {
+  const std::vector<InputValue> inputs(values.begin(), values.end());
+  return evaluate(detail::InputView(inputs.data()), params);
+}
+
+double FormulaAst::evaluate(const detail::InputView& values, const std::vector<double>& params) const {
   switch (nodetype_) {
     case NodeType::Literal:
       return std::get<double>(data_);
     case NodeType::Variable:
-      return std::get<double>(values[std::get<size_t>(data_)]);
+      return values[std::get<size_t>(data_)].real();
     case NodeType::Parameter:
       return params[std::get<size_t>(data_)];
     case NodeType::Unary: {
@@ -291,3 +298,140 @@ double FormulaAst::evaluate(const std::vector<Variable::Type>& values, const std
     default: std::abort(); // never reached if the switch/case is exhaustive
   }
 }
+
+namespace {
+  // entries evaluated at once, so that the intermediate results stay in cache
+  constexpr size_t formula_batch_block = 256;
+
+  size_t tree_depth(const FormulaAst& ast) {
+    size_t depth {0};
+    for (const auto& child : ast.children()) depth = std::max(depth, tree_depth(child));
+    return depth + 1;
+  }
+
+  template<typename F>
+  void apply(double * out, size_t n, F f) {
+    for (size_t i=0; i < n; ++i) out[i] = f(out[i]);
+  }
+
+  template<typename F>
+  void apply(double * out, const double * right, size_t n, F f) {
+    for (size_t i=0; i < n; ++i) out[i] = f(out[i], right[i]);
+  }
+}
+
+void FormulaAst::evaluate(const detail::BatchView& values, const std::vector<double>& params, double * out) const {
+  // one block per level of the tree, for the right operands of binary nodes
+  detail::ScratchBuffer<double> scratch(values.scratch(), tree_depth(*this) * formula_batch_block);
+  for (size_t start=0; start < values.size(); start += formula_batch_block) {
+    const size_t n = std::min(formula_batch_block, values.size() - start);
+    evaluate(values, params, start, n, out + start, scratch.data());
+  }
+}
+
+// the same operations as the scalar evaluate, one node at a time over the block
+void FormulaAst::evaluate(const detail::BatchView& values, const std::vector<double>& params,
+    size_t start, size_t n, double * out, double * scratch) const {
+  switch (nodetype_) {
+    case NodeType::Literal:
+      std::fill(out, out + n, std::get<double>(data_));
+      return;
+    case NodeType::Variable: {
+      const auto& column = values[std::get<size_t>(data_)];
+      if ( column.broadcast() ) {
+        std::fill(out, out + n, column[0].real());
+      }
+      else if ( column.single() ) {
+        const float * data = static_cast<const float*>(column.data()) + start;
+        std::copy(data, data + n, out);
+      }
+      else {
+        const double * data = static_cast<const double*>(column.data()) + start;
+        std::copy(data, data + n, out);
+      }
+      return;
+    }
+    case NodeType::Parameter:
+      std::fill(out, out + n, params[std::get<size_t>(data_)]);
+      return;
+    case NodeType::Unary: {
+      children_[0].evaluate(values, params, start, n, out, scratch);
+      switch (std::get<UnaryOp>(data_)) {
+        case UnaryOp::Negative: return apply(out, n, [](double x) { return -x; });
+        case UnaryOp::Log: return apply(out, n, [](double x) { return std::log(x); });
+        case UnaryOp::Log10: return apply(out, n, [](double x) { return std::log10(x); });
+        case UnaryOp::Exp: return apply(out, n, [](double x) { return std::exp(x); });
+        case UnaryOp::Erf: return apply(out, n, [](double x) { return std::erf(x); });
+        case UnaryOp::Sqrt: return apply(out, n, [](double x) { return std::sqrt(x); });
+        case UnaryOp::Abs: return apply(out, n, [](double x) { return std::abs(x); });
+        case UnaryOp::Cos: return apply(out, n, [](double x) { return std::cos(x); });
+        case UnaryOp::Sin: return apply(out, n, [](double x) { return std::sin(x); });
+        case UnaryOp::Tan: return apply(out, n, [](double x) { return std::tan(x); });
+        case UnaryOp::Acos: return apply(out, n, [](double x) { return std::acos(x); });
+        case UnaryOp::Asin: return apply(out, n, [](double x) { return std::asin(x); });
+        case UnaryOp::Atan: return apply(out, n, [](double x) { return std::atan(x); });
+        case UnaryOp::Cosh: return apply(out, n, [](double x) { return std::cosh(x); });
+        case UnaryOp::Sinh: return apply(out, n, [](double x) { return std::sinh(x); });
+        case UnaryOp::Tanh: return apply(out, n, [](double x) { return std::tanh(x); });
+        case UnaryOp::Acosh: return apply(out, n, [](double x) { return std::acosh(x); });
+        case UnaryOp::Asinh: return apply(out, n, [](double x) { return std::asinh(x); });
+        case UnaryOp::Atanh: return apply(out, n, [](double x) { return std::atanh(x); });
+        default: std::abort();
+      };
+    }
+    case NodeType::Binary: {
+      children_[0].evaluate(values, params, start, n, out, scratch);
+      double * right = scratch;
+      children_[1].evaluate(values, params, start, n, right, scratch + formula_batch_block);
+      switch (std::get<BinaryOp>(data_)) {
+        case BinaryOp::LogicalOr: return apply(out, right, n, [](double l, double r) { return ((l != 0.0) || (r != 0.0)) ? 1. : 0.; });
+        case BinaryOp::LogicalAnd: return apply(out, right, n, [](double l, double r) { return ((l != 0.0) && (r != 0.0)) ? 1. : 0.; });
+        case BinaryOp::Equal: return apply(out, right, n, [](double l, double r) { return (l == r) ? 1. : 0.; });
+        case BinaryOp::NotEqual: return apply(out, right, n, [](double l, double r) { return (l != r) ? 1. : 0.; });
+        case BinaryOp::Greater: return apply(out, right, n, [](double l, double r) { return (l > r) ? 1. : 0.; });
+        case BinaryOp::Less: return apply(out, right, n, [](double l, double r) { return (l < r) ? 1. : 0.; });
+        case BinaryOp::GreaterEq: return apply(out, right, n, [](double l, double r) { return (l >= r) ? 1. : 0.; });
+        case BinaryOp::LessEq: return apply(out, right, n, [](double l, double r) { return (l <= r) ? 1. : 0.; });
+        case BinaryOp::Minus: return apply(out, right, n, [](double l, double r) { return l - r; });
+        case BinaryOp::Plus: return apply(out, right, n, [](double l, double r) { return l + r; });
+        case BinaryOp::Div: return apply(out, right, n, [](double l, double r) { return l / r; });
+        case BinaryOp::Times: return apply(out, right, n, [](double l, double r) { return l * r; });
+        case BinaryOp::Pow: return apply(out, right, n, [](double l, double r) { return std::pow(l, r); });
+        case BinaryOp::Atan2: return apply(out, right, n, [](double l, double r) { return std::atan2(l, r); });
+        case BinaryOp::Max: return apply(out, right, n, [](double l, double r) { return std::max(l, r); });
+        case BinaryOp::Min: return apply(out, right, n, [](double l, double r) { return std::min(l, r); });
+        default: std::abort();
+      };
+    }
+    default: std::abort(); // never reached if the switch/case is exhaustive
+  }
+}
+
+FormulaAst FormulaAst::specialize(const detail::Specialization& spec) const {
+  switch (nodetype_) {
+    case NodeType::Variable: {
+      const size_t idx = std::get<size_t>(data_);
+      if ( spec.fixed(idx) ) {
+        return {NodeType::Literal, std::get<double>(spec.value(idx)), {}};
+      }
+      return {NodeType::Variable, spec.remap[idx], {}};
+    }
+    case NodeType::Unary:
+    case NodeType::Binary: {
+      Children children;
+      bool constant {true};
+      for (const auto& child : children_) {
+        children.push_back(child.specialize(spec));
+        constant = constant && (children.back().nodetype() == NodeType::Literal);
+      }
+      FormulaAst out(nodetype_, data_, std::move(children));
+      if ( constant ) {
+        // same operations in the same order as evaluate() would do per call
+        return {NodeType::Literal, out.evaluate(detail::InputView(nullptr), {}), {}};
+      }
+      return out;
+    }
+    default:
+      return *this;
+  }
+}
@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <cmath>
+#include <new>
 #include <sstream>
+#include <Eigen/Dense>
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
 #include "lwtnn/LightweightNeuralNetwork.hh"
@@ -8,17 +12,192 @@
 
 using namespace correction;
 
+namespace {
+  // The same computation as lwt::LightweightNeuralNetwork, on plain buffers that
+  // can be reused between evaluations. Only networks of dense layers are supported.
+  class DenseStack {
+    public:
+      // nullptr if the network has layers or activations that are not supported
+      static std::shared_ptr<const DenseStack> build(const lwt::JSONConfig& cfg);
+      // number of values that the buffers passed to compute must hold
+      Eigen::Index width() const { return width_; };
+      // values: (unscaled) inputs, both buffers width() long
+      // Returns the buffer holding the outputs.
+      double * compute(double * values, double * scratch) const;
+
+    private:
+      struct Layer {
+        Eigen::MatrixXd weights; // empty if none
+        Eigen::VectorXd bias; // empty if none
+        lwt::ActivationConfig activation;
+      };
+      static bool supported(lwt::Activation activation);
+      static void activate(const lwt::ActivationConfig& activation, Eigen::Map<Eigen::VectorXd>& values);
+
+      Eigen::VectorXd offsets_;
+      Eigen::VectorXd scales_;
+      std::vector<Layer> layers_;
+      Eigen::Index width_;
+  };
+
+  // the activation functions of lwtnn
+  double nn_sigmoid(double x) {
+    if (x < -30.0) return 0.0;
+    if (x > 30.0) return 1.0;
+    return 1.0 / (1.0 + std::exp(-1.0*x));
+  }
+
+  double nn_hard_sigmoid(double x) {
+    double out = 0.2*x + 0.5;
+    if (out < 0) return 0.0;
+    if (out > 1) return 1.0;
+    return out;
+  }
+
+  double nn_relu(double x) {
+    if (std::isnan(x)) return x;
+    return x > 0 ? x : 0;
+  }
+
+  std::shared_ptr<const DenseStack> DenseStack::build(const lwt::JSONConfig& cfg) {
+    auto out = std::make_shared<DenseStack>();
+    out->offsets_.resize(cfg.inputs.size());
+    out->scales_.resize(cfg.inputs.size());
+    for (size_t i=0; i < cfg.inputs.size(); ++i) {
+      out->offsets_(i) = cfg.inputs[i].offset;
+      out->scales_(i) = cfg.inputs[i].scale;
+    }
+    size_t n = cfg.inputs.size();
+    size_t width = n;
+    for (const auto& layer : cfg.layers) {
+      if ( layer.architecture != lwt::Architecture::DENSE
+          || ! layer.sublayers.empty()
+          || ! supported(layer.activation.function) ) {
+        return nullptr;
+      }
+      Layer dense;
+      if ( ! layer.weights.empty() ) {
+        if ( n == 0 || layer.weights.size() % n != 0 ) return nullptr;
+        const size_t nout = layer.weights.size() / n;
+        // row-major in the configuration, as in lwt::build_matrix
+        dense.weights = Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(
+            layer.weights.data(), nout, n);
+        n = nout;
+        width = std::max(width, n);
+      }
+      if ( ! layer.bias.empty() ) {
+        if ( layer.bias.size() != n ) return nullptr;
+        dense.bias = Eigen::Map<const Eigen::VectorXd>(layer.bias.data(), layer.bias.size());
+      }
+      dense.activation = layer.activation;
+      out->layers_.push_back(std::move(dense));
+    }
+    if ( n != cfg.outputs.size() ) return nullptr;
+    out->width_ = width;
+    return out;
+  }
+
+  bool DenseStack::supported(lwt::Activation activation) {
+    switch ( activation ) {
+      case lwt::Activation::LINEAR:
+      case lwt::Activation::SIGMOID:
+      case lwt::Activation::HARD_SIGMOID:
+      case lwt::Activation::RECTIFIED:
+      case lwt::Activation::TANH:
+      case lwt::Activation::SOFTMAX:
+      case lwt::Activation::ELU:
+      case lwt::Activation::LEAKY_RELU:
+      case lwt::Activation::SWISH:
+      case lwt::Activation::ABS:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  void DenseStack::activate(const lwt::ActivationConfig& activation, Eigen::Map<Eigen::VectorXd>& values) {
+    const double alpha = activation.alpha;
+    switch ( activation.function ) {
+      case lwt::Activation::SIGMOID:
+        values = values.unaryExpr([](double x) { return nn_sigmoid(x); }); break;
+      case lwt::Activation::HARD_SIGMOID:
+        values = values.unaryExpr([](double x) { return nn_hard_sigmoid(x); }); break;
+      case lwt::Activation::RECTIFIED:
+        values = values.unaryExpr([](double x) { return nn_relu(x); }); break;
+      case lwt::Activation::TANH:
+        values = values.unaryExpr([](double x) { return std::tanh(x); }); break;
+      case lwt::Activation::ELU:
+        values = values.unaryExpr([alpha](double x) { return x >= 0 ? x : alpha * (std::exp(x) - 1); }); break;
+      case lwt::Activation::LEAKY_RELU:
+        values = values.unaryExpr([alpha](double x) { return x > 0 ? x : alpha * x; }); break;
+      case lwt::Activation::SWISH:
+        values = values.unaryExpr([alpha](double x) { return x * nn_sigmoid(alpha * x); }); break;
+      case lwt::Activation::ABS:
+        values = values.unaryExpr([](double x) { return std::abs(x); }); break;
+      case lwt::Activation::SOFTMAX:
+        values = values.unaryExpr([](double x) { return std::exp(x); });
+        values /= values.sum();
+        break;
+      default: // LINEAR
+        break;
+    }
+  }
+
+  double * DenseStack::compute(double * values, double * scratch) const {
+    using Map = Eigen::Map<Eigen::VectorXd>;
+    Eigen::Index rows = offsets_.size();
+    {
+      Map x(values, rows);
+      x = (x + offsets_).cwiseProduct(scales_);
+    }
+    for (const auto& layer : layers_) {
+      if ( layer.weights.size() > 0 ) {
+        Map z(scratch, layer.weights.rows());
+        z.noalias() = layer.weights * Map(values, rows);
+        std::swap(values, scratch);
+        rows = layer.weights.rows();
+      }
+      Map x(values, rows);
+      if ( layer.bias.size() > 0 ) {
+        x += layer.bias;
+      }
+      activate(layer.activation, x);
+    }
+    return values;
+  }
+
+  // values per buffer of a single evaluation that are kept on the stack
+  constexpr Eigen::Index lwtnn_stack_width = 64;
+  // in doubles, the largest alignment of Eigen's allocations
+  constexpr Eigen::Index lwtnn_align = 8;
+}
+
 class detail::LWTNNEvaluationContext {
   public:
     LWTNNEvaluationContext(const JSONObject& json, const Correction& context);
-    double evaluate(const std::vector<Variable::Type>& values) const;
+    double evaluate(const detail::InputView& values) const;
+    void evaluate(const detail::BatchView& values, double * out) const;
+    std::unique_ptr<const LWTNNEvaluationContext> specialize(const Specialization& spec) const;
+    std::vector<size_t> variables() const;
 
   private:
+    LWTNNEvaluationContext() = default;
+    // with lwt::LightweightNeuralNetwork, for networks DenseStack does not support
+    double evaluate_lwtnn(const detail::InputView& values) const;
+
+    // marks an input of nn_inputs_ that is fixed by specialize
+    static constexpr size_t fixed_input = static_cast<size_t>(-1);
+
     // pointers to pointers to pointers to ...
-    std::unique_ptr<const lwt::LightweightNeuralNetwork> nn_;
-    std::vector<std::pair<std::string, size_t>> input_spec_;
-    std::vector<std::string> output_names_;
-    std::unique_ptr<Formula> finalizer_;
+    // the network and finalizer are shared with specialized copies
+    std::shared_ptr<const lwt::LightweightNeuralNetwork> nn_;
+    std::shared_ptr<const DenseStack> dense_; // nullptr if nn_ is used
+    // in the order of the network inputs: the correction input index, or the fixed value
+    std::vector<std::pair<size_t, double>> nn_inputs_;
+    // the network inputs and outputs, the latter are also the finalizer variables
+    std::shared_ptr<const std::vector<std::string>> input_names_;
+    std::shared_ptr<const std::vector<std::string>> output_names_;
+    Formula::Ref finalizer_;
 };
 
 detail::LWTNNEvaluationContext::LWTNNEvaluationContext(const JSONObject& json, const Correction& context)
@@ -32,22 +211,25 @@ detail::LWTNNEvaluationContext::LWTNNEvaluationContext(const JSONObject& json, c
   try {
     cfg = lwt::parse_json(in);
 
+    std::vector<std::string> input_names;
     for (const auto& input : cfg.inputs) {
       size_t idx = find_input_index(input.name, context.inputs());
       if ( context.inputs().at(idx).type() == Variable::VarType::string ) {
         throw std::runtime_error("LWTNN cannot use string inputs, but input '" + input.name + "' has string type");
       }
-      input_spec_.emplace_back(input.name, idx);
+      input_names.push_back(input.name);
+      nn_inputs_.emplace_back(idx, 0.);
     }
+    input_names_ = std::make_shared<const std::vector<std::string>>(std::move(input_names));
 
     std::vector<Variable> finalize_inputs;
     for (const auto& name : cfg.outputs) {
-      output_names_.push_back(name);
       finalize_inputs.emplace_back(name, "", Variable::VarType::real);
     }
-    if ( output_names_.empty() ) {
+    if ( cfg.outputs.empty() ) {
       throw std::runtime_error("LWTNN model has no outputs");
     }
+    output_names_ = std::make_shared<const std::vector<std::string>>(cfg.outputs);
 
     const auto& finalizer_data = json.getRequiredValue("finalizer");
     if ( finalizer_data.IsObject()
@@ -55,13 +237,14 @@ detail::LWTNNEvaluationContext::LWTNNEvaluationContext(const JSONObject& json, c
         && finalizer_data["nodetype"].IsString()
         && finalizer_data["nodetype"] == "formula"
       ) {
-      finalizer_ = std::make_unique<Formula>(JSONObject(finalizer_data.GetObject()), finalize_inputs);
+      finalizer_ = std::make_shared<const Formula>(JSONObject(finalizer_data.GetObject()), finalize_inputs);
     }
     else {
       throw std::runtime_error("LWTNN finalizer must be a formula node");
     }
 
-    nn_ = std::make_unique<const lwt::LightweightNeuralNetwork>(cfg.inputs, cfg.layers, cfg.outputs);
+    nn_ = std::make_shared<const lwt::LightweightNeuralNetwork>(cfg.inputs, cfg.layers, cfg.outputs);
+    dense_ = DenseStack::build(cfg);
   } catch (const std::exception& ex) {
     throw std::runtime_error(
       std::string("Failed to parse LWTNN model from 'opaque' field: ") + ex.what()
@@ -69,46 +252,143 @@ detail::LWTNNEvaluationContext::LWTNNEvaluationContext(const JSONObject& json, c
   }
 }
 
-double detail::LWTNNEvaluationContext::evaluate(const std::vector<Variable::Type>& values) const
+double detail::LWTNNEvaluationContext::evaluate(const detail::InputView& values) const
 {
-  // TODO: thread_local?
-  lwt::ValueMap input_map;
+  if ( ! dense_ ) return evaluate_lwtnn(values);
 
-  for (const auto& [name, idx] : input_spec_) {
-    if ( auto pval = std::get_if<double>(&values[idx]) ) {
-      input_map[name] = *pval;
-    }
-    else if ( auto pval = std::get_if<int64_t>(&values[idx]) ) {
-      input_map[name] = static_cast<double>(*pval);
-    }
-    else {
-      throw std::runtime_error("LWTNN input " + name + " has non-numeric type");
-    }
+  // Buffers local to the call, on the stack unless the network is wide. They are
+  // aligned as Eigen allocates vectors, as in lwtnn, so that sums are done in the same order.
+  const Eigen::Index width = dense_->width();
+  const Eigen::Index stride = (width + lwtnn_align - 1) / lwtnn_align * lwtnn_align;
+  alignas(lwtnn_align * sizeof(double)) double stack[2 * lwtnn_stack_width];
+  alignas(InputValue) std::byte stack_outputs[lwtnn_stack_width * sizeof(InputValue)];
+  Eigen::VectorXd heap;
+  std::vector<InputValue> heap_outputs;
+  double * buffer1 = stack;
+  InputValue * outputs = reinterpret_cast<InputValue*>(stack_outputs);
+  if ( stride > lwtnn_stack_width ) {
+    heap.resize(2 * stride);
+    buffer1 = heap.data();
+    heap_outputs.resize(output_names_->size(), InputValue(0.));
+    outputs = heap_outputs.data();
+  }
+  double * buffer2 = buffer1 + stride;
+
+  for (size_t k=0; k < nn_inputs_.size(); ++k) {
+    const auto& [idx, value] = nn_inputs_[k];
+    buffer1[k] = ( idx == fixed_input ) ? value : values[idx].number();
+  }
+  const double * result = dense_->compute(buffer1, buffer2);
+  for (size_t k=0; k < output_names_->size(); ++k) new (outputs + k) InputValue(result[k]);
+  return finalizer_->evaluate(detail::InputView(outputs));
+}
+
+double detail::LWTNNEvaluationContext::evaluate_lwtnn(const detail::InputView& values) const
+{
+  lwt::ValueMap input_map;
+  for (size_t k=0; k < nn_inputs_.size(); ++k) {
+    const auto& [idx, value] = nn_inputs_[k];
+    input_map[(*input_names_)[k]] = ( idx == fixed_input ) ? value : values[idx].number();
   }
 
   const auto output_map = nn_->compute(input_map);
 
-  std::vector<Variable::Type> finalizer_inputs;
-  finalizer_inputs.reserve(output_names_.size());
-  for (const auto& name : output_names_) {
+  std::vector<InputValue> outputs;
+  outputs.reserve(output_names_->size());
+  for (const auto& name : *output_names_) {
     const auto it = output_map.find(name);
     if ( it == output_map.end() ) {
       throw std::runtime_error("LWTNN output missing expected key: " + name);
     }
-    finalizer_inputs.emplace_back(it->second);
+    outputs.emplace_back(it->second);
   }
 
-  return finalizer_->evaluate(finalizer_inputs);
+  return finalizer_->evaluate(detail::InputView(outputs.data()));
+}
+
+void detail::LWTNNEvaluationContext::evaluate(const detail::BatchView& values, double * out) const
+{
+  std::vector<InputValue> row(std::max(values.ncolumns(), output_names_->size()), InputValue(0.));
+  if ( ! dense_ ) {
+    const detail::InputView view(row.data());
+    for (size_t i=0; i < values.size(); ++i) {
+      values.gather(i, row.data());
+      out[i] = evaluate_lwtnn(view);
+    }
+    return;
+  }
+
+  // Each entry is computed as in a single evaluation, with the same matrix-vector
+  // products, so that the results are identical. Only the buffers are shared.
+  const Eigen::Index width = dense_->width();
+  const Eigen::Index stride = (width + lwtnn_align - 1) / lwtnn_align * lwtnn_align;
+  Eigen::VectorXd buffers(2 * stride);
+  const detail::InputView outputs(row.data());
+  for (size_t i=0; i < values.size(); ++i) {
+    for (size_t k=0; k < nn_inputs_.size(); ++k) {
+      const auto& [idx, value] = nn_inputs_[k];
+      buffers(k) = ( idx == fixed_input ) ? value : values[idx][i].number();
+    }
+    const double * result = dense_->compute(buffers.data(), buffers.data() + stride);
+    for (size_t k=0; k < output_names_->size(); ++k) row[k] = result[k];
+    out[i] = finalizer_->evaluate(outputs);
+  }
+}
+
+std::unique_ptr<const detail::LWTNNEvaluationContext> detail::LWTNNEvaluationContext::specialize(const Specialization& spec) const
+{
+  std::unique_ptr<LWTNNEvaluationContext> out(new LWTNNEvaluationContext());
+  out->nn_ = nn_;
+  out->dense_ = dense_;
+  for (const auto& [idx, value] : nn_inputs_) {
+    if ( idx == fixed_input ) {
+      out->nn_inputs_.emplace_back(idx, value);
+    }
+    else if ( spec.fixed(idx) ) {
+      out->nn_inputs_.emplace_back(fixed_input, InputValue(spec.value(idx)).number());
+    }
+    else {
+      out->nn_inputs_.emplace_back(spec.remap[idx], 0.);
+    }
+  }
+  out->input_names_ = input_names_;
+  out->output_names_ = output_names_;
+  out->finalizer_ = finalizer_;
+  return out;
+}
+
+std::vector<size_t> detail::LWTNNEvaluationContext::variables() const
+{
+  std::vector<size_t> out;
+  for (const auto& [idx, value] : nn_inputs_) {
+    if ( idx != fixed_input ) out.push_back(idx);
+  }
+  return out;
 }
 
 LWTNN::LWTNN(const JSONObject& json, const Correction& context) :
   model_(std::make_unique<const detail::LWTNNEvaluationContext>(json, context))
 {}
 
+LWTNN::LWTNN() = default;
 LWTNN::~LWTNN() = default;
 LWTNN::LWTNN(LWTNN&&) = default;
 LWTNN& LWTNN::operator=(LWTNN&&) = default;
 
-double LWTNN::evaluate(const std::vector<Variable::Type>& values) const {
+double LWTNN::evaluate(const detail::InputView& values) const {
   return model_->evaluate(values);
 }
+
+void LWTNN::evaluate(const detail::BatchView& values, double * out) const {
+  model_->evaluate(values, out);
+}
+
+std::vector<size_t> LWTNN::variables() const {
+  return model_->variables();
+}
+
+Content LWTNN::specialize(const detail::Specialization& spec) const {
+  LWTNN out;
+  out.model_ = model_->specialize(spec);
+  return out;
+}
@@ -1,6 +1,7 @@
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <deque>
 #include "correction.h"
 
 namespace py = pybind11;
@@ -31,57 +32,206 @@ namespace {
     return py::cast<std::vector<Variable::Type>>(args);
   }
 
-  template<typename T> // Correction or CompoundCorrection
-  py::array_t<double> evalv(T& c, py::args args) {
-    std::vector<Variable::Type> inputs;
-    inputs.reserve(py::len(args));
-    std::vector<std::pair<size_t, py::buffer_info>> vargs;
-    check_length(c, args);
-    for (size_t i=0; i < py::len(args); ++i) {
-      if ( py::isinstance<py::array>(args[i]) ) {
-        if ( c.inputs()[i].type() == Variable::VarType::integer ) {
-          vargs.emplace_back(i, py::cast<py::array_t<int64_t, py::array::c_style | py::array::forcecast>>(args[i]).request());
-          inputs.emplace_back(0);
+  // Converts python arguments to input columns. The converted arrays are
+  // kept alive here, and an array passed for several inputs of the same type
+  // is only converted once. float32 arrays are used as they are for real inputs.
+  class ColumnConverter {
+    public:
+      InputColumn convert(py::handle arg, const Variable& input, size_t position) {
+        if ( ! py::isinstance<py::array>(arg) ) {
+          scalars_.push_back(py::cast<Variable::Type>(arg));
+          return InputColumn(InputValue(scalars_.back()));
         }
-        else if ( c.inputs()[i].type() == Variable::VarType::real ) {
-          vargs.emplace_back(i, py::cast<py::array_t<double, py::array::c_style | py::array::forcecast>>(args[i]).request());
-          inputs.emplace_back(0.0);
-        }
-        else {
-          throw std::invalid_argument("Array arguments only allowed for integer and real input types");
+        auto key = std::make_pair(arg.ptr(), input.type());
+        auto it = arrays_.find(key);
+        if ( it == arrays_.end() ) {
+          py::array array;
+          if ( input.type() == Variable::VarType::integer ) {
+            array = py::cast<py::array_t<int64_t, py::array::c_style | py::array::forcecast>>(arg);
+          }
+          else if ( input.type() == Variable::VarType::real && py::cast<py::array>(arg).dtype().is(py::dtype::of<float>()) ) {
+            array = py::cast<py::array_t<float, py::array::c_style | py::array::forcecast>>(arg);
+          }
+          else if ( input.type() == Variable::VarType::real ) {
+            array = py::cast<py::array_t<double, py::array::c_style | py::array::forcecast>>(arg);
+          }
+          else {
+            throw std::invalid_argument("Array arguments only allowed for integer and real input types");
+          }
+          it = arrays_.emplace(key, std::move(array)).first;
         }
-
-        if ( vargs.back().second.ndim != 1 ) {
+        const auto& array = it->second;
+        if ( array.ndim() != 1 ) {
           throw std::invalid_argument("Array arguments with dimension greater "
-              "than one are not supported (argument at position " + std::to_string(i) + ")");
+              "than one are not supported (argument at position " + std::to_string(position) + ")");
         }
-        if ( vargs.back().second.size != vargs.front().second.size ) {
+        if ( size_ >= 0 && array.size() != size_ ) {
           throw std::invalid_argument("Array arguments must all have the same size"
-              "(argument at position " + std::to_string(i) + " is length "
-              + std::to_string(vargs.back().second.size) + ")");
+              "(argument at position " + std::to_string(position) + " is length "
+              + std::to_string(array.size()) + ")");
         }
+        size_ = array.size();
+        if ( input.type() == Variable::VarType::integer ) {
+          return InputColumn(static_cast<const int64_t*>(array.data()));
+        }
+        if ( array.dtype().is(py::dtype::of<float>()) ) {
+          return InputColumn(static_cast<const float*>(array.data()));
+        }
+        return InputColumn(static_cast<const double*>(array.data()));
       }
-      else {
-        inputs.push_back(py::cast<Variable::Type>(args[i]));
+
+      // number of entries, 1 if all arguments are scalars
+      py::ssize_t size() const { return ( size_ >= 0 ) ? size_ : 1; }
+
+    private:
+      std::map<std::pair<PyObject*, Variable::VarType>, py::array> arrays_;
+      std::deque<Variable::Type> scalars_; // stable, the columns view the strings in place
+      py::ssize_t size_ = -1;
+  };
+
+  // T is Correction or CompoundCorrection, Out the output type (double or float)
+  template<typename T, typename Out = double>
+  py::array_t<Out> evalv(T& c, py::args args) {
+    check_length(c, args);
+    ColumnConverter converter;
+    std::vector<InputColumn> columns;
+    columns.reserve(py::len(args));
+    for (size_t i=0; i < py::len(args); ++i) {
+      columns.push_back(converter.convert(args[i], c.inputs()[i], i));
+    }
+    auto output = py::array_t<Out>(converter.size());
+    Out * outptr = output.mutable_data();
+    {
+      py::gil_scoped_release release;
+      c.evaluate_batch(columns.data(), columns.size(), output.size(), outptr);
+    }
+    return output;
+  }
+
+  // as evalv, with the scratch memory of the nodes taken from context
+  template<typename T> // Correction or CompoundCorrection
+  py::array_t<double> evalv_context(T& c, EvaluationContext& context, py::args args) {
+    check_length(c, args);
+    ColumnConverter converter;
+    std::vector<InputColumn> columns;
+    columns.reserve(py::len(args));
+    for (size_t i=0; i < py::len(args); ++i) {
+      columns.push_back(converter.convert(args[i], c.inputs()[i], i));
+    }
+    auto output = py::array_t<double>(converter.size());
+    double * outptr = output.mutable_data();
+    {
+      py::gil_scoped_release release;
+      c.evaluate_batch(columns.data(), columns.size(), output.size(), outptr, context);
+    }
+    return output;
+  }
+
+  // entries that cannot be evaluated are set to fill instead of raising,
+  // returns the values and the Correction::EntryStatus of each entry
+  template<typename Out = double>
+  py::tuple evalv_status(const Correction& c, double fill, py::args args) {
+    check_length(c, args);
+    ColumnConverter converter;
+    std::vector<InputColumn> columns;
+    columns.reserve(py::len(args));
+    for (size_t i=0; i < py::len(args); ++i) {
+      columns.push_back(converter.convert(args[i], c.inputs()[i], i));
+    }
+    auto output = py::array_t<Out>(converter.size());
+    auto status = py::array_t<uint8_t>(converter.size());
+    Out * outptr = output.mutable_data();
+    auto * statusptr = reinterpret_cast<Correction::EntryStatus*>(status.mutable_data());
+    {
+      py::gil_scoped_release release;
+      c.evaluate_batch(columns.data(), columns.size(), output.size(), outptr, fill, statusptr);
+    }
+    return py::make_tuple(output, status);
+  }
+
+  // args are the inputs other than input_name, one row of the result per key
+  py::array_t<double> evaluate_variations(const Correction& c, const std::string& input_name,
+      const std::vector<std::string>& keys, py::args args) {
+    if ( py::len(args) + 1 != c.inputs().size() ) {
+      throw std::invalid_argument("Incorrect number of inputs (got " + std::to_string(py::len(args))
+          + ", expected " + std::to_string(c.inputs().size() - 1) + ")");
+    }
+    ColumnConverter converter;
+    std::vector<InputColumn> columns;
+    for (const auto& input : c.inputs()) {
+      if ( input.name() == input_name || columns.size() == py::len(args) ) continue;
+      columns.push_back(converter.convert(args[columns.size()], input, columns.size()));
+    }
+    const py::ssize_t size = converter.size();
+    auto output = py::array_t<double>({static_cast<py::ssize_t>(keys.size()), size});
+    double * outptr = output.mutable_data();
+    {
+      py::gil_scoped_release release;
+      c.evaluate_variations(input_name, keys, columns.data(), columns.size(), size, outptr);
+    }
+    return output;
+  }
+
+  // args are the points of each input, in order: a scalar, or a 1-d array
+  // (a list for string inputs) for an axis of the result
+  py::array_t<double> evaluate_grid(const Correction& c, py::args args) {
+    check_length(c, args);
+    std::deque<ColumnConverter> converters; // one per input, the axes differ in size
+    std::deque<std::vector<std::string>> keys;
+    std::deque<std::vector<std::string_view>> views;
+    std::vector<InputColumn> axes;
+    std::vector<size_t> sizes;
+    std::vector<py::ssize_t> shape;
+    for (size_t i=0; i < py::len(args); ++i) {
+      const auto& input = c.inputs()[i];
+      if ( input.type() == Variable::VarType::string && py::isinstance<py::list>(args[i]) ) {
+        const auto& strings = keys.emplace_back(py::cast<std::vector<std::string>>(args[i]));
+        const auto& view = views.emplace_back(strings.begin(), strings.end());
+        axes.push_back(InputColumn(view.data()));
+        sizes.push_back(view.size());
+        shape.push_back(view.size());
+        continue;
       }
+      auto& converter = converters.emplace_back();
+      axes.push_back(converter.convert(args[i], input, i));
+      sizes.push_back(converter.size());
+      if ( ! axes.back().broadcast() ) shape.push_back(converter.size());
     }
-    auto output = py::array_t<double>((vargs.size() > 0) ? vargs.front().second.size : 1);
-    py::buffer_info outbuffer = output.request();
-    double * outptr = static_cast<double*>(outbuffer.ptr);
+    auto output = py::array_t<double>(shape);
+    double * outptr = output.mutable_data();
     {
       py::gil_scoped_release release;
-      for (long i=0; i < outbuffer.shape[0]; ++i) {
-        for (const auto& varg : vargs) {
-          if ( std::holds_alternative<int64_t>(inputs[varg.first]) ) {
-            inputs[varg.first] = static_cast<int64_t*>(varg.second.ptr)[i];
-          }
-          else if ( std::holds_alternative<double>(inputs[varg.first]) ) {
-            inputs[varg.first] = static_cast<double*>(varg.second.ptr)[i];
-          }
+      c.evaluate_grid(axes.data(), sizes.data(), axes.size(), outptr);
+    }
+    return output;
+  }
+
+  // requests maps correction names to their arguments by input name,
+  // one row of the result per correction
+  py::array_t<double> evaluate_many(const CorrectionSet& cset, py::dict requests) {
+    ColumnConverter converter;
+    std::vector<std::string> names;
+    std::vector<std::vector<InputColumn>> columns;
+    for (const auto& [name, args] : requests) {
+      names.push_back(py::cast<std::string>(name));
+      const auto corr = cset.at(names.back());
+      const auto kwargs = py::cast<py::dict>(args);
+      auto& cols = columns.emplace_back();
+      for (size_t i=0; i < corr->inputs().size(); ++i) {
+        const auto& input = corr->inputs()[i];
+        if ( ! kwargs.contains(input.name()) ) {
+          throw std::invalid_argument("Missing input " + input.name() + " for correction " + names.back());
         }
-        outptr[i] = c.evaluate(inputs);
+        cols.push_back(converter.convert(kwargs[py::str(input.name())], input, i));
       }
     }
+    const py::ssize_t size = converter.size();
+    auto output = py::array_t<double>({static_cast<py::ssize_t>(names.size()), size});
+    double * outptr = output.mutable_data();
+    {
+      py::gil_scoped_release release;
+      cset.evaluate_many(names, columns, size, outptr);
+    }
     return output;
   }
 }
@@ -94,6 +244,18 @@ PYBIND11_MODULE(_core, m, py::mod_gil_not_used()) {
         .def_property_readonly("type", &Variable::typeStr)
         .def_static("from_string", &Variable::from_string);
 
+    py::class_<EvaluationContext>(m, "EvaluationContext")
+        .def(py::init<bool>(), py::arg("count") = false)
+        .def_property_readonly("stats", [](const EvaluationContext& context) {
+          const auto stats = context.stats();
+          py::dict out;
+          out["evaluations"] = stats.evaluations;
+          out["entries"] = stats.entries;
+          out["scratch_bytes"] = stats.scratch_bytes;
+          return out;
+        })
+        .def("release", &EvaluationContext::release);
+
     py::class_<Correction, std::shared_ptr<Correction>>(m, "Correction")
         .def_property_readonly("name", &Correction::name)
         .def_property_readonly("description", &Correction::description)
@@ -103,7 +265,46 @@ PYBIND11_MODULE(_core, m, py::mod_gil_not_used()) {
         .def("evaluate", [](Correction& c, py::args args) {
           return c.evaluate(validate_pyargs(c, args));
         })
-        .def("evalv", evalv<Correction>);
+        .def("evalv", evalv<Correction>)
+        .def("evalv_float32", evalv<Correction, float>)
+        .def("evalv_context", evalv_context<Correction>)
+        .def("evalv_status", evalv_status<>)
+        .def("evalv_status_float32", evalv_status<float>)
+        .def("evaluate_variations", evaluate_variations)
+        .def("evaluate_grid", evaluate_grid)
+        .def("specialize", &Correction::specialize)
+        .def("cached", &Correction::cached)
+        .def("tabulated", [](const Correction& c, double tolerance,
+              const std::map<std::string, std::pair<double, double>>& domains, size_t max_points) {
+          std::vector<Correction::TabulationEntry> report;
+          auto out = c.tabulated({tolerance, domains, max_points}, &report);
+          py::list entries;
+          for (const auto& entry : report) {
+            py::dict item;
+            item["node"] = entry.node;
+            item["inputs"] = entry.inputs;
+            item["domain"] = entry.domain;
+            item["points"] = entry.points;
+            item["max_error"] = entry.max_error;
+            item["bytes"] = entry.bytes;
+            item["tabulated"] = entry.tabulated;
+            entries.append(item);
+          }
+          return py::make_tuple(out, entries);
+        }, py::arg("tolerance"), py::arg("domains"), py::arg("max_points") = 65536)
+        .def("coalesced", [](const Correction& c) {
+          size_t removed {0};
+          auto out = c.coalesced(&removed);
+          return py::make_tuple(out, removed);
+        })
+        .def_property_readonly("cache_stats", [](const Correction& c) {
+          const auto stats = c.cache_stats();
+          py::dict out;
+          out["capacity"] = stats.capacity;
+          out["hits"] = stats.hits;
+          out["misses"] = stats.misses;
+          return out;
+        });
 
     py::class_<CompoundCorrection, std::shared_ptr<CompoundCorrection>>(m, "CompoundCorrection")
         .def_property_readonly("name", &CompoundCorrection::name)
@@ -113,7 +314,9 @@ PYBIND11_MODULE(_core, m, py::mod_gil_not_used()) {
         .def("evaluate", [](CompoundCorrection& c, py::args args) {
           return c.evaluate(validate_pyargs(c, args));
         })
-        .def("evalv", evalv<CompoundCorrection>);
+        .def("evalv", evalv<CompoundCorrection>)
+        .def("evalv_float32", evalv<CompoundCorrection, float>)
+        .def("evalv_context", evalv_context<CompoundCorrection>);
 
     py::class_<CorrectionSet>(m, "CorrectionSet")
         .def_static("from_file", &CorrectionSet::from_file)
@@ -125,7 +328,8 @@ PYBIND11_MODULE(_core, m, py::mod_gil_not_used()) {
         .def("__iter__", [](const CorrectionSet &v) {
           return py::make_key_iterator(v.begin(), v.end());
         }, py::keep_alive<0, 1>())
-        .def_property_readonly("compound", &CorrectionSet::compound);
+        .def_property_readonly("compound", &CorrectionSet::compound)
+        .def("evaluate_many", evaluate_many);
 
     py::class_<Formula, std::shared_ptr<Formula>>(m, "Formula")
       .def_static("from_string", &Formula::from_string)
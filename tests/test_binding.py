@@ -2,6 +2,7 @@ import os
 import shutil
 import subprocess
 import tempfile
+from pathlib import Path
 
 import correctionlib.version
 import pytest
@@ -82,23 +83,15 @@ int main(int argc, char** argv) {
 """
 
 
-@pytest.mark.skipif(shutil.which("cmake") is None, reason="cmake not found")
-@pytest.mark.skipif(os.name == "nt", reason="there is a segfault I cannot debug")
-def test_cmake_static_compilation(csetstr: str):
+def build_and_run(source: str):
+    """Compile a C++ program against the installed correctionlib and run it"""
     with tempfile.TemporaryDirectory() as tmpdir:
         cmake = os.path.join(tmpdir, "CMakeLists.txt")
         with open(cmake, "w") as f:
             f.write(CMAKELIST_SRC)
         testprog = os.path.join(tmpdir, "test.cc")
-
-        # SKBUILD_PROJECT_VERSION stores the normalized base version and trims
-        # any prerelease/dev suffixes, so mirror that behavior here.
-        from packaging.version import Version
-
-        versionstr = Version(correctionlib.version.version).base_version
-
         with open(testprog, "w") as f:
-            f.write(TESTPROG_SRC % (versionstr, csetstr))
+            f.write(source)
         flags = (
             subprocess.check_output(["correction", "config", "--cmake"])
             .decode()
@@ -115,9 +108,221 @@ def test_cmake_static_compilation(csetstr: str):
             print(ret.stderr.decode())
             raise RuntimeError(f"cmake build failed (args: {ret.args})")
         prog = r"Debug\test.exe" if os.name == "nt" else "test"
-        subprocess.run(
-            [os.path.join(tmpdir, prog)], capture_output=True, check=True, cwd=tmpdir
+        ret = subprocess.run(
+            [os.path.join(tmpdir, prog)], capture_output=True, cwd=tmpdir
         )
+        if ret.returncode != 0:
+            print(ret.stdout.decode())
+            print(ret.stderr.decode())
+            raise RuntimeError(f"test program failed (return code {ret.returncode})")
+
+
+@pytest.mark.skipif(shutil.which("cmake") is None, reason="cmake not found")
+@pytest.mark.skipif(os.name == "nt", reason="there is a segfault I cannot debug")
+def test_cmake_static_compilation(csetstr: str):
+    # SKBUILD_PROJECT_VERSION stores the normalized base version and trims
+    # any prerelease/dev suffixes, so mirror that behavior here.
+    from packaging.version import Version
+
+    versionstr = Version(correctionlib.version.version).base_version
+    build_and_run(TESTPROG_SRC % (versionstr, csetstr))
+
+
+BIND_SRC = """\
+#include <iostream>
+#include "correction.h"
+
+using correction::CorrectionSet;
+
+int main(int argc, char** argv) {
+  auto cset = CorrectionSet::from_string("%s");
+  auto corr = cset->at("ptweight");
+  auto f = corr->bind<double>();
+  for (double pt : {0., 12., 25., 45., 100., 200.}) {
+    if (f(pt) != corr->evaluate({pt})) {
+      std::cerr << "mismatch at pt = " << pt << std::endl;
+      return 1;
+    }
+  }
+  try {
+    corr->bind<int64_t>();
+    return 1;
+  } catch (std::runtime_error&) {}
+  try {
+    corr->bind<double, double>();
+    return 1;
+  } catch (std::invalid_argument&) {}
+  return 0;
+}
+"""
+
+
+@pytest.mark.skipif(shutil.which("cmake") is None, reason="cmake not found")
+@pytest.mark.skipif(os.name == "nt", reason="there is a segfault I cannot debug")
+def test_cmake_bind(csetstr: str):
+    build_and_run(BIND_SRC % csetstr)
+
+
+@pytest.fixture(scope="module")
+def csetstr_noalloc():
+    def ptbinning(offset):
+        return cs.Binning(
+            nodetype="binning",
+            input="pt",
+            edges=[20.0, 50.0, 100.0, 1000.0],
+            content=[
+                offset,
+                cs.Formula(
+                    nodetype="formula",
+                    expression=f"{offset}+0.001*x",
+                    parser="TFormula",
+                    variables=["pt"],
+                ),
+                1.0,
+            ],
+            flow="clamp",
+        )
+
+    # long keys so that strings do not fit in the small-string buffer
+    systs = ["central", "up_jesRelativeBal_2018", "down_jesRelativeBal_2018"]
+    btag = cs.Correction(
+        name="btag",
+        version=1,
+        inputs=[
+            cs.Variable(name="syst", type="string"),
+            cs.Variable(name="flav", type="int"),
+            cs.Variable(name="pt", type="real"),
+        ],
+        output=cs.Variable(name="weight", type="real"),
+        data=cs.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                cs.CategoryItem(
+                    key=syst,
+                    value=cs.Category(
+                        nodetype="category",
+                        input="flav",
+                        content=[
+                            cs.CategoryItem(key=flav, value=ptbinning(1.0 + 0.1 * i))
+                            for flav in [0, 4, 5]
+                        ],
+                    ),
+                )
+                for i, syst in enumerate(systs)
+            ],
+        ),
+    )
+    scale = cs.Correction(
+        name="scale",
+        version=1,
+        inputs=[
+            cs.Variable(name="pt", type="real"),
+            cs.Variable(name="event", type="int"),
+        ],
+        output=cs.Variable(name="weight", type="real"),
+        data=cs.Transform(
+            nodetype="transform",
+            input="pt",
+            rule=cs.Formula(
+                nodetype="formula",
+                expression="1.01*x",
+                parser="TFormula",
+                variables=["pt"],
+            ),
+            content=cs.Binning(
+                nodetype="binning",
+                input="pt",
+                edges=[0.0, 100.0, 1000.0],
+                content=[
+                    cs.HashPRNG(
+                        nodetype="hashprng",
+                        inputs=["event", "pt"],
+                        distribution="normal",
+                    ),
+                    1.0,
+                ],
+                flow="clamp",
+            ),
+        ),
+    )
+    total = cs.CompoundCorrection(
+        name="total",
+        inputs=[
+            cs.Variable(name="syst", type="string"),
+            cs.Variable(name="flav", type="int"),
+            cs.Variable(name="pt", type="real"),
+            cs.Variable(name="event", type="int"),
+        ],
+        output=cs.Variable(name="weight", type="real"),
+        inputs_update=["pt"],
+        input_op="*",
+        output_op="*",
+        stack=["scale", "btag"],
+    )
+    cset = cs.CorrectionSet(
+        schema_version=2, corrections=[btag, scale], compound_corrections=[total]
+    )
+    return cset.model_dump_json().replace('"', r"\"")
+
+
+NOALLOC_SRC = """\
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "correction.h"
+
+using namespace correction;
+
+static size_t allocations = 0;
+
+void* operator new(std::size_t size) {
+  ++allocations;
+  if (void* ptr = std::malloc(size)) return ptr;
+  throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+int main(int argc, char** argv) {
+  auto cset = CorrectionSet::from_string("%s");
+  auto btag = cset->at("btag");
+  auto scale = cset->at("scale");
+  auto total = cset->compound().at("total");
+  auto nn = CorrectionSet::from_file("%s")->at("electron_fastsim_sf");
+  const std::string syst = "up_jesRelativeBal_2018";
+  double sum = 0.;
+  auto run = [&](int64_t n) {
+    for (int64_t i = 0; i < n; ++i) {
+      const double pt = 10. + i;
+      const InputValue b[] = {syst, 5, pt};
+      sum += btag->evaluate(b, 3);
+      const InputValue s[] = {pt, i};
+      sum += scale->evaluate(s, 2);
+      const InputValue t[] = {syst, 5, pt, i};
+      sum += total->evaluate(t, 4);
+      const InputValue e[] = {pt, 0.4, 2.1, 1e-3};
+      sum += nn->evaluate(e, 4);
+    }
+  };
+  run(10);  // fills the per-thread scratch storage
+  allocations = 0;
+  run(1000);
+  if (allocations != 0) {
+    std::cerr << allocations << " allocations in 4000 calls" << std::endl;
+    return 1;
+  }
+  std::cout << sum << std::endl;
+  return 0;
+}
+"""
+
+
+@pytest.mark.skipif(shutil.which("cmake") is None, reason="cmake not found")
+@pytest.mark.skipif(os.name == "nt", reason="there is a segfault I cannot debug")
+def test_cmake_noalloc(csetstr_noalloc: str):
+    lwtnn = Path(__file__).parent / "data" / "lwtnn_example.json"
+    build_and_run(NOALLOC_SRC % (csetstr_noalloc, lwtnn.as_posix()))
 
 
 def test_cli_config_paths():
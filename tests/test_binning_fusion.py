@@ -0,0 +1,77 @@
+import numpy
+import pytest
+
+import correctionlib._core as core
+from correctionlib import schemav2 as schema
+
+
+def make_cset(flow, inner_flow):
+    def ptbinning(offset):
+        return schema.Binning(
+            nodetype="binning",
+            input="pt",
+            edges=[20.0, 30.0, 50.0, 100.0],
+            content=[offset + i for i in range(3)],
+            flow=inner_flow,
+        )
+
+    corr = schema.Correction(
+        name="sf",
+        version=1,
+        inputs=[
+            schema.Variable(name="eta", type="real"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Binning(
+            nodetype="binning",
+            input="eta",
+            edges=schema.UniformBinning(n=4, low=-2.5, high=2.5),
+            content=[ptbinning(10.0 * i) for i in range(4)],
+            flow=flow,
+        ),
+    )
+    cset = schema.CorrectionSet(schema_version=2, corrections=[corr])
+    return core.CorrectionSet.from_string(cset.model_dump_json())["sf"]
+
+
+def expected(eta, pt, flow, default=None):
+    ieta = numpy.floor((eta + 2.5) / 1.25)
+    ipt = numpy.searchsorted([20.0, 30.0, 50.0, 100.0], pt, side="right") - 1
+    if flow == "clamp":
+        return 10.0 * numpy.clip(ieta, 0, 3) + numpy.clip(ipt, 0, 2)
+    out = 10.0 * ieta + ipt
+    outside = (ieta < 0) | (ieta > 3) | (ipt < 0) | (ipt > 2)
+    return numpy.where(outside, default, out)
+
+
+def test_binning_fusion():
+    # nested binnings are evaluated as one multi-dimensional binning, with
+    # the flow behavior and default of the levels
+    rng = numpy.random.default_rng(7)
+    eta = rng.uniform(-3.0, 3.0, 1000)
+    pt = rng.uniform(10.0, 120.0, 1000)
+    inside = (numpy.abs(eta) < 2.5) & (pt >= 20.0) & (pt < 100.0)
+
+    corr = make_cset("clamp", "clamp")
+    assert list(corr.evalv(eta, pt)) == list(expected(eta, pt, "clamp"))
+    assert corr.evaluate(-3.0, 120.0) == 2.0
+
+    corr = make_cset(-1.0, -1.0)
+    assert list(corr.evalv(eta, pt)) == list(expected(eta, pt, "value", -1.0))
+
+    # different defaults per level are kept
+    corr = make_cset(-1.0, -2.0)
+    assert corr.evaluate(3.0, 25.0) == -1.0
+    assert corr.evaluate(0.5, 5.0) == -2.0
+    assert corr.evaluate(3.0, 5.0) == -1.0
+
+    corr = make_cset("error", "error")
+    out = corr.evalv(eta[inside], pt[inside])
+    assert list(out) == list(expected(eta[inside], pt[inside], "error"))
+    with pytest.raises(RuntimeError):
+        corr.evaluate(3.0, 25.0)
+    with pytest.raises(RuntimeError):
+        corr.evaluate(0.5, 5.0)
+    with pytest.raises(RuntimeError):
+        corr.evalv(eta, pt)
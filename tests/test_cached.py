@@ -0,0 +1,83 @@
+import pickle
+
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_corr():
+    corr = schema.Correction(
+        name="slow",
+        version=1,
+        inputs=[
+            schema.Variable(name="syst", type="string"),
+            schema.Variable(name="njet", type="int"),
+            schema.Variable(name="x", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                schema.CategoryItem(
+                    key="central",
+                    value=schema.Formula(
+                        nodetype="formula",
+                        expression="exp(x)*sin(x) + 1.5*log(x + 10)",
+                        parser="TFormula",
+                        variables=["x"],
+                    ),
+                ),
+                schema.CategoryItem(
+                    key="up",
+                    value=schema.Formula(
+                        nodetype="formula",
+                        expression="1/x",
+                        parser="TFormula",
+                        variables=["x"],
+                    ),
+                ),
+            ],
+        ),
+    )
+    cset = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )
+    return cset["slow"]
+
+
+def test_cached():
+    corr = make_corr()
+    assert corr.cache_stats == {"capacity": 0, "hits": 0, "misses": 0}
+    with pytest.raises(ValueError):
+        corr.cached(0)
+
+    cached = corr.cached(64)
+    assert cached.cache_stats["capacity"] == 64
+    for _ in range(3):
+        for syst in ["central", "up"]:
+            for x in [0.0, -0.0, 0.5, 1.5]:
+                assert cached.evaluate(syst, 2, x) == corr.evaluate(syst, 2, x)
+    assert cached.cache_stats == {"capacity": 64, "hits": 16, "misses": 8}
+
+    # errors are not cached
+    with pytest.raises(IndexError):
+        cached.evaluate("down", 2, 0.5)
+
+    # arrays are evaluated entry by entry through the cache
+    x = numpy.tile(numpy.linspace(-1.0, 1.0, 10), 100)
+    cached = corr.cached(64)
+    assert numpy.array_equal(
+        cached.evaluate("central", 3, x), corr.evaluate("central", 3, x)
+    )
+    assert cached.cache_stats["misses"] == 10
+
+    # specialize and pickle keep the cache capacity
+    s = cached.specialize({"syst": "central"})
+    assert s.cache_stats == {"capacity": 64, "hits": 0, "misses": 0}
+    assert s.evaluate(3, 0.25) == corr.evaluate("central", 3, 0.25)
+    s2 = pickle.loads(pickle.dumps(s))
+    assert s2.cache_stats["capacity"] == 64
+    assert s2.evaluate(3, 0.25) == s.evaluate(3, 0.25)
@@ -0,0 +1,99 @@
+import pickle
+
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_corr(flow):
+    def formula(scale):
+        return schema.Formula(
+            nodetype="formula",
+            expression=f"1 + {scale}*log(x)",
+            parser="TFormula",
+            variables=["pt"],
+        )
+
+    def ptbinning(offset):
+        # a repeated scale factor of 1.0 at low pt and a plateau at high pt
+        return schema.Binning(
+            nodetype="binning",
+            input="pt",
+            edges=[20.0, 30.0, 40.0, 50.0, 70.0, 100.0, 200.0, 500.0, 1000.0],
+            content=[1.0, 1.0, 1.0, formula(0.01), formula(0.02)] + [offset + 1.5] * 3,
+            flow=flow,
+        )
+
+    corr = schema.Correction(
+        name="sf",
+        version=1,
+        inputs=[
+            schema.Variable(name="flav", type="int"),
+            schema.Variable(name="eta", type="real"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="flav",
+            content=[
+                schema.CategoryItem(
+                    key=flav,
+                    value=schema.Binning(
+                        nodetype="binning",
+                        input="eta",
+                        edges=[-2.5, -1.5, 0.0, 1.5, 2.5],
+                        # the same subtree in the two central bins
+                        content=[
+                            ptbinning(0.1 * flav),
+                            ptbinning(0.2 * flav),
+                            ptbinning(0.2 * flav),
+                            ptbinning(0.3 * flav),
+                        ],
+                        flow=flow,
+                    ),
+                )
+                for flav in [0, 4, 5]
+            ],
+        ),
+    )
+    cset = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )
+    return cset["sf"]
+
+
+@pytest.mark.parametrize("flow", ["clamp", "error", 0.5])
+def test_coalesced(flow):
+    corr = make_corr(flow)
+    merged, removed = corr.coalesced()
+    # the eta and pt binnings are fused into one table per flavour: 2 + 2 pt
+    # edges go, and the eta edges between equal bins (3 for flav 0, 1 else)
+    assert removed == 3 * 4 + 3 + 1 + 1
+    assert merged.coalesced()[1] == 0
+
+    rng = numpy.random.default_rng(7)
+    flav = rng.choice([0, 4, 5], 5000)
+    eta = rng.uniform(-3.0, 3.0, 5000)
+    pt = rng.uniform(10.0, 1200.0, 5000)
+    # hit the edges, including those removed
+    pt[::10] = rng.choice([20.0, 30.0, 40.0, 50.0, 100.0, 200.0, 500.0], 500)
+    eta[::7] = rng.choice([-2.5, -1.5, 0.0, 1.5], 715)
+    if flow == "error":
+        with pytest.raises(RuntimeError):
+            merged.evaluate(flav, eta, pt)
+        inside = (numpy.abs(eta) < 2.5) & (pt >= 20.0) & (pt < 1000.0)
+        flav, eta, pt = flav[inside], eta[inside], pt[inside]
+    expected = corr.evaluate(flav, eta, pt)
+    assert list(merged.evaluate(flav, eta, pt)) == list(expected)
+    assert [
+        merged.evaluate(int(f), float(e), float(p)) for f, e, p in zip(flav, eta, pt)
+    ] == list(expected)
+
+    # specialize and pickle keep the merged bins
+    special = merged.specialize({"flav": 4})
+    again = pickle.loads(pickle.dumps(special))
+    assert list(again.evaluate(eta, pt)) == list(corr.evaluate(4, eta, pt))
+    assert again.coalesced()[1] == 0
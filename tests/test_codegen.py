@@ -0,0 +1,217 @@
+import math
+import random
+import shutil
+import subprocess
+
+import pytest
+
+import correctionlib
+import correctionlib.schemav2 as cs
+from correctionlib.codegen import generate
+
+
+def make_cset():
+    def formula(expr, *variables, parameters=None):
+        return cs.Formula(
+            nodetype="formula",
+            expression=expr,
+            parser="TFormula",
+            variables=list(variables),
+            parameters=parameters,
+        )
+
+    def ptbinning(offset, flow):
+        return cs.Binning(
+            nodetype="binning",
+            input="pt",
+            edges=[20.0, 30.0, 50.0, 100.0, 1000.0],
+            content=[
+                offset,
+                formula("[0] + 0.001*x - exp(-x/[1])", "pt", parameters=[offset, 50.0]),
+                cs.FormulaRef(nodetype="formularef", index=0, parameters=[offset, 0.1]),
+                1.0 + offset,
+            ],
+            flow=flow,
+        )
+
+    btag = cs.Correction(
+        name="btag",
+        version=1,
+        inputs=[
+            cs.Variable(name="syst", type="string"),
+            cs.Variable(name="pos", type="int"),
+            cs.Variable(name="eta", type="real"),
+            cs.Variable(name="pt", type="real"),
+        ],
+        output=cs.Variable(name="weight", type="real"),
+        generic_formulas=[formula("[0] + [1]*log(x)^2", "pt")],
+        data=cs.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                cs.CategoryItem(
+                    key=syst,
+                    value=cs.Category(
+                        nodetype="category",
+                        input="pos",
+                        content=[
+                            cs.CategoryItem(
+                                key=flav,
+                                value=cs.Binning(
+                                    nodetype="binning",
+                                    input="eta",
+                                    edges=cs.UniformBinning(n=4, low=-2.5, high=2.5),
+                                    content=[
+                                        ptbinning(
+                                            0.1 * i + 0.01 * flav + 0.001 * j, flow
+                                        )
+                                        for j in range(4)
+                                    ],
+                                    flow=flow,
+                                ),
+                            )
+                            for flav in [0, 4, 5]
+                        ],
+                        default=0.5 if syst != "down" else None,
+                    ),
+                )
+                for i, (syst, flow) in enumerate(
+                    [("central", "clamp"), ("up", "error"), ("down", "wrap")]
+                )
+            ],
+        ),
+    )
+    sf = cs.Correction(
+        name="sf",
+        version=1,
+        # names of locals and functions in the generated code, which must
+        # not clash with the arguments
+        inputs=[
+            cs.Variable(name="cl_value", type="real"),
+            cs.Variable(name="pt", type="real"),
+            cs.Variable(name="norm", type="int"),
+        ],
+        output=cs.Variable(name="weight", type="real"),
+        data=cs.Transform(
+            nodetype="transform",
+            input="norm",
+            rule=formula("x/10", "pt"),
+            content=cs.MultiBinning(
+                nodetype="multibinning",
+                inputs=["cl_value", "norm", "pt"],
+                edges=[
+                    [-2.5, -1.0, 1.0, 2.5],
+                    cs.UniformBinning(n=3, low=0, high=6),
+                    [20.0, 40.0, "inf"],
+                ],
+                content=[
+                    (
+                        formula("(x > 1.5) * atan2(x, y) + max(x, y)", "cl_value", "pt")
+                        if i % 4 == 0
+                        else 0.5 * i
+                    )
+                    for i in range(3 * 3 * 2)
+                ],
+                flow=-1.0,
+            ),
+        ),
+    )
+    return cs.CorrectionSet(schema_version=2, corrections=[btag, sf])
+
+
+DRIVER_SRC = """\
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "%s.h"
+
+int main() {
+%s
+  while (std::cin >> %s) {
+    try {
+      std::printf("%%.17g\\n", %s::evaluate(%s));
+    } catch (const std::out_of_range&) {
+      std::printf("IndexError\\n");
+    } catch (const std::exception&) {
+      std::printf("RuntimeError\\n");
+    }
+  }
+  return 0;
+}
+"""
+
+
+def random_input(var, rng):
+    if var.type == "string":
+        return rng.choice(["central", "up", "down", "other"])
+    if var.type == "int":
+        return rng.choice([0, 4, 5, 21, -3, 7, 60])
+    if rng.random() < 0.1:
+        return rng.choice([-2.5, -1.0, 1.0, 2.5, 20.0, 30.0, 50.0, 100.0])
+    return rng.uniform(-3.0, 1200.0) if var.name == "pt" else rng.uniform(-3.0, 3.0)
+
+
+@pytest.mark.skipif(shutil.which("c++") is None, reason="no C++ compiler")
+@pytest.mark.parametrize("name", ["btag", "sf"])
+def test_codegen(tmp_path, name):
+    # the generated header must agree with the evaluator on random inputs
+    cset = make_cset()
+    path = tmp_path / "cset.json"
+    path.write_text(cset.model_dump_json())
+    subprocess.check_call(
+        [
+            "correction",
+            "codegen",
+            str(path),
+            "--name",
+            name,
+            "-o",
+            tmp_path / f"{name}.h",
+        ]
+    )
+
+    corr = correctionlib.CorrectionSet(cset)[name]
+    inputs = cset.corrections[[c.name for c in cset.corrections].index(name)].inputs
+    ctypes = {"real": "double", "int": "std::int64_t", "string": "std::string"}
+    declarations = "\n".join(f"  {ctypes[v.type]} {v.name};" for v in inputs)
+    names = [v.name for v in inputs]
+    (tmp_path / "driver.cc").write_text(
+        DRIVER_SRC % (name, declarations, " >> ".join(names), name, ", ".join(names))
+    )
+    subprocess.check_call(
+        ["c++", "-std=c++17", "-O2", "-ffp-contract=off", "driver.cc", "-o", "driver"],
+        cwd=tmp_path,
+    )
+
+    rng = random.Random(42)
+    rows = [[random_input(var, rng) for var in inputs] for _ in range(5000)]
+    stdin = "".join(" ".join(repr(x) for x in row) + "\n" for row in rows)
+    stdin = stdin.replace("'", "")
+    out = subprocess.run(
+        ["./driver"], cwd=tmp_path, input=stdin, capture_output=True, text=True
+    ).stdout.split()
+    assert len(out) == len(rows)
+    for row, result in zip(rows, out):
+        try:
+            expected = corr.evaluate(*row)
+        except IndexError:
+            assert result == "IndexError", row
+        except RuntimeError:
+            assert result == "RuntimeError", row
+        else:
+            # only math functions folded or rewritten by the compiler may
+            # differ, in the last bit
+            assert math.isclose(float(result), expected, rel_tol=1e-14), row
+
+
+def test_codegen_unsupported():
+    corr = cs.Correction(
+        name="prng",
+        version=1,
+        inputs=[cs.Variable(name="event", type="int")],
+        output=cs.Variable(name="weight", type="real"),
+        data=cs.HashPRNG(nodetype="hashprng", inputs=["event"], distribution="normal"),
+    )
+    with pytest.raises(ValueError, match="hashprng"):
+        generate(corr.model_dump(mode="json"))
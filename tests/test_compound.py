@@ -1,6 +1,8 @@
 import math
 import pickle
 
+import numpy
+
 import correctionlib
 import correctionlib.schemav2
 
@@ -74,3 +76,16 @@ def test_compound():
 
     corr2 = pickle.loads(pickle.dumps(corr))
     assert corr2.evaluate(0.0, 10.0) == (1 + 0.1 * math.log10(10)) * 1.1
+
+    # batch evaluation runs the stack column by column
+    pt = numpy.linspace(5.0, 100.0, 20)
+    eta = numpy.linspace(-2.5, 2.5, 20)
+    corr = cset.compound["l1l2"]
+    assert list(corr.evaluate(pt, eta)) == [
+        corr.evaluate(a, b) for a, b in zip(pt, eta)
+    ]
+    assert list(corr.evaluate(pt, 1.2)) == [corr.evaluate(a, 1.2) for a in pt]
+    corr = cset.compound["multiplied"]
+    assert list(corr.evaluate(eta, pt)) == [
+        corr.evaluate(a, b) for a, b in zip(eta, pt)
+    ]
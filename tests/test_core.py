@@ -699,6 +699,48 @@ def test_category():
         corr.evaluate("one")
 
 
+def test_category_lookup():
+    def make_cat(keys, vtype):
+        cset = wrap(
+            schema.Correction(
+                name="test",
+                version=2,
+                inputs=[schema.Variable(name="cat", type=vtype)],
+                output=schema.Variable(name="a scale", type="real"),
+                data=schema.Category(
+                    nodetype="category",
+                    input="cat",
+                    content=[
+                        {"key": key, "value": float(i)} for i, key in enumerate(keys)
+                    ],
+                ),
+            )
+        )
+        return cset["test"]
+
+    # dense integer keys
+    corr = make_cat([5, 0, 4], "int")
+    assert [corr.evaluate(k) for k in (0, 4, 5)] == [1.0, 2.0, 0.0]
+    for key in (-1, 1, 3, 6, 2**62, -(2**62)):
+        with pytest.raises(IndexError):
+            corr.evaluate(key)
+
+    # sparse integer keys, e.g. run numbers
+    runs = [271036 + 37 * i for i in range(500)] + [-5, 0, 2**31 - 1]
+    corr = make_cat(runs, "int")
+    assert all(corr.evaluate(run) == float(i) for i, run in enumerate(runs))
+    for key in (271037, 1, -6, 2**41):
+        with pytest.raises(IndexError):
+            corr.evaluate(key)
+
+    keys = ["central", "up", "down"] + [f"up_jes{i}" for i in range(100)] + [""]
+    corr = make_cat(keys, "string")
+    assert all(corr.evaluate(key) == float(i) for i, key in enumerate(keys))
+    for key in ("Central", "up_jes100", "centra", "central "):
+        with pytest.raises(IndexError):
+            corr.evaluate(key)
+
+
 def test_binning():
     def binning(flow, uniform=True):
         if uniform:
@@ -833,6 +875,53 @@ def test_binning():
         assert corr.evaluate(0.0, 10.0) == 0.0
 
 
+@pytest.mark.parametrize("uniform", [True, False])
+def test_multibinning_edges(uniform):
+    # the multibinning lookup must agree with binning exactly, including at and
+    # around the bin edges where a reciprocal bin width could round differently
+    if uniform:
+        edges = schema.UniformBinning(n=7, low=-2.4, high=2.5)
+        points = [-2.4 + 4.9 * i / 7 for i in range(8)]
+    else:
+        edges = [-2.4, -1.1, -0.3, 0.0, 0.2, 0.9, 1.7, 2.5, 3.1, 5.0]
+        points = list(edges)
+    content = [float(i) for i in range(len(points) - 1)]
+    inputs = [schema.Variable(name="x", type="real")]
+    output = schema.Variable(name="a scale", type="real")
+    cset = wrap(
+        schema.Correction(
+            name="binning",
+            version=2,
+            inputs=inputs,
+            output=output,
+            data=schema.Binning(
+                nodetype="binning",
+                input="x",
+                edges=edges,
+                content=content,
+                flow="clamp",
+            ),
+        ),
+        schema.Correction(
+            name="multibinning",
+            version=2,
+            inputs=inputs,
+            output=output,
+            data=schema.MultiBinning(
+                nodetype="multibinning",
+                inputs=["x"],
+                edges=[edges],
+                content=content,
+                flow="clamp",
+            ),
+        ),
+    )
+    for point in points[:-1]:
+        below, above = math.nextafter(point, -math.inf), math.nextafter(point, math.inf)
+        for x in (below, point, above):
+            assert cset["multibinning"].evaluate(x) == cset["binning"].evaluate(x)
+
+
 def test_formularef():
     cset = wrap(
         schema.Correction(
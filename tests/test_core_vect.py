@@ -75,3 +75,102 @@ def test_core_vectorized():
         corr.evalv(a, b, ""),
         numpy.where(b == 1, a, -99.0),
     )
+
+
+def test_core_vectorized_empty():
+    # no child to evaluate an empty batch with
+    cset = wrap(
+        schema.Correction(
+            name="test",
+            version=1,
+            inputs=[
+                schema.Variable(name="a", type="real"),
+                schema.Variable(name="b", type="int"),
+            ],
+            output=schema.Variable(name="a scale", type="real"),
+            data={"nodetype": "category", "input": "b", "content": []},
+        )
+    )
+    corr = cset["test"]
+
+    assert corr.evalv(numpy.zeros(0), numpy.zeros(0, dtype=numpy.int64)).shape == (0,)
+    assert corr.evalv(numpy.zeros(0), 1).shape == (0,)
+    with pytest.raises(IndexError):
+        corr.evalv(numpy.zeros(3), 1)
+
+
+def test_core_vectorized_context():
+    # one context reused over batches of several sizes, routed through
+    # Category, Transform and Binning nodes with formula contents
+    def formula(expression):
+        return schema.Formula(
+            nodetype="formula",
+            expression=expression,
+            parser="TFormula",
+            variables=["pt"],
+        )
+
+    def transform(scale):
+        return schema.Transform(
+            nodetype="transform",
+            input="pt",
+            rule=formula(f"{scale}*x"),
+            content=schema.Binning(
+                nodetype="binning",
+                input="pt",
+                edges=[0.0, 20.0, 50.0, 100.0],
+                content=[
+                    scale,
+                    formula(f"{scale}*log(x)"),
+                    formula(f"{scale} + 0.001*x"),
+                ],
+                flow="clamp",
+            ),
+        )
+
+    cset = wrap(
+        schema.Correction(
+            name="test",
+            version=1,
+            inputs=[
+                schema.Variable(name="flav", type="int"),
+                schema.Variable(name="pt", type="real"),
+            ],
+            output=schema.Variable(name="weight", type="real"),
+            data=schema.Category(
+                nodetype="category",
+                input="flav",
+                content=[
+                    schema.CategoryItem(key=flav, value=transform(scale))
+                    for flav, scale in [(0, 1.0), (4, 1.1), (5, 0.9)]
+                ],
+                default=1.0,
+            ),
+        )
+    )
+    corr = cset["test"]
+    rng = numpy.random.default_rng(7)
+    sizes = [1, 1000, 10, 0, 1000, 3]
+    context = core.EvaluationContext(count=True)
+    scratch = []
+    for size in sizes:
+        flav = rng.choice([0, 4, 5, 21], size)
+        pt = rng.uniform(0.0, 150.0, size)
+        out = corr.evalv_context(context, flav, pt)
+        assert numpy.array_equal(out, corr.evalv(flav, pt))
+        scratch.append(context.stats["scratch_bytes"])
+    assert context.stats["evaluations"] == len(sizes)
+    assert context.stats["entries"] == sum(sizes)
+    # the memory of the largest batch is kept and reused by the others
+    assert scratch[1] > 0
+    assert scratch[1:] == [scratch[1]] * (len(sizes) - 1)
+    context.release()
+    assert context.stats["scratch_bytes"] == 0
+
+    context = core.EvaluationContext()
+    assert corr.evalv_context(context, 4, numpy.array([30.0])).tolist() == [
+        corr.evaluate(4, 30.0)
+    ]
+    assert context.stats["evaluations"] == 0
+    with pytest.raises(ValueError):
+        corr.evalv_context(context, 4)
@@ -0,0 +1,139 @@
+import math
+
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_corr():
+    corr = schema.Correction(
+        name="sf",
+        version=1,
+        inputs=[
+            schema.Variable(name="syst", type="string"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                schema.CategoryItem(
+                    key="central",
+                    value=schema.Binning(
+                        nodetype="binning",
+                        input="pt",
+                        edges=[20.0, 50.0, 100.0],
+                        content=[
+                            1.1,
+                            schema.Formula(
+                                nodetype="formula",
+                                expression="1 + 0.001*x",
+                                parser="TFormula",
+                                variables=["pt"],
+                            ),
+                        ],
+                        flow="error",
+                    ),
+                ),
+                schema.CategoryItem(key="up", value=1.2),
+            ],
+        ),
+    )
+    cset = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )
+    return cset["sf"]
+
+
+def test_error_policy():
+    corr = make_corr()
+    pt = numpy.array([[10.0, 30.0], [70.0, 150.0]])
+    syst = "central"
+
+    with pytest.raises(RuntimeError, match="below bounds"):
+        corr.evaluate(syst, pt)
+    with pytest.raises(RuntimeError, match="below bounds"):
+        corr.evaluate(syst, pt, errors="raise")
+    with pytest.raises(ValueError):
+        corr.evaluate(syst, pt, errors="ignore")
+
+    expected = numpy.array([[-1.0, 1.1], [1.07, -1.0]])
+    assert numpy.allclose(corr.evaluate(syst, pt, errors=-1.0), expected)
+    out = corr.evaluate(syst, pt, errors="nan")
+    assert out.shape == (2, 2)
+    assert numpy.isnan(out[0, 0]) and numpy.isnan(out[1, 1])
+    assert out[0, 1] == 1.1
+
+    values, status = corr.evaluate_status(syst, pt, fill=0.0)
+    assert status.dtype == numpy.uint8
+    assert status.tolist() == [[1, 0], [0, 1]]
+    assert numpy.allclose(values, [[0.0, 1.1], [1.07, 0.0]])
+
+    # missing category keys
+    values, status = corr.evaluate_status("down", numpy.array([30.0, 70.0]))
+    assert status.tolist() == [2, 2]
+    assert numpy.isnan(values).all()
+
+    # scalars
+    assert corr.evaluate("down", 30.0, errors=0.5) == 0.5
+    assert corr.evaluate("central", 30.0, errors=0.5) == 1.1
+    with pytest.raises(IndexError):
+        corr.evaluate("down", 30.0)
+
+
+def test_error_policy_transform():
+    # a rule that fails for some entries, above a content that would clamp
+    def transform(input, rule):
+        return schema.Transform(
+            nodetype="transform",
+            input=input,
+            rule=schema.Binning(
+                nodetype="binning",
+                input="pt",
+                edges=[20.0, 50.0, 100.0],
+                content=rule,
+                flow="error",
+            ),
+            content=schema.Binning(
+                nodetype="binning",
+                input=input,
+                edges=[0.0, 5.0, 50.0, 1000.0],
+                content=[1.0, 2.0, 3.0],
+                flow="clamp",
+            ),
+        )
+
+    corr = schema.Correction(
+        name="sf",
+        version=1,
+        inputs=[
+            schema.Variable(name="syst", type="string"),
+            schema.Variable(name="pt", type="real"),
+            schema.Variable(name="n", type="int"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                schema.CategoryItem(key="real", value=transform("pt", [25.0, 75.0])),
+                schema.CategoryItem(key="int", value=transform("n", [3.0, 7.0])),
+            ],
+        ),
+    )
+    corr = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )["sf"]
+
+    pt = numpy.array([10.0, 30.0, 70.0, 150.0])
+    for syst, expected in [("real", [2.0, 3.0]), ("int", [1.0, 2.0])]:
+        with pytest.raises(RuntimeError, match="below bounds"):
+            corr.evaluate(syst, pt, 1)
+        for c in [corr, corr.cached(16)]:
+            values, status = c.evaluate_status(syst, pt, 1, fill=-1.0)
+            assert status.tolist() == [1, 0, 0, 1]
+            assert values.tolist() == [-1.0, *expected, -1.0]
+        assert corr.evaluate(syst, pt[1:3], 1).tolist() == expected
@@ -0,0 +1,122 @@
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_cset():
+    def corr(name, expression, variables):
+        return schema.Correction(
+            name=name,
+            version=1,
+            inputs=[
+                schema.Variable(name="syst", type="string"),
+                schema.Variable(name="eta", type="real"),
+                schema.Variable(name="pt", type="real"),
+            ],
+            output=schema.Variable(name="weight", type="real"),
+            data=schema.Category(
+                nodetype="category",
+                input="syst",
+                content=[
+                    schema.CategoryItem(
+                        key="central",
+                        value=schema.Binning(
+                            nodetype="binning",
+                            input="eta",
+                            edges=[-2.5, 0.0, 2.5],
+                            content=[
+                                1.1,
+                                schema.Formula(
+                                    nodetype="formula",
+                                    expression=expression,
+                                    parser="TFormula",
+                                    variables=variables,
+                                ),
+                            ],
+                            flow="clamp",
+                        ),
+                    ),
+                    schema.CategoryItem(key="up", value=1.2),
+                ],
+            ),
+        )
+
+    btag = schema.Correction(
+        name="btag",
+        version=1,
+        inputs=[
+            schema.Variable(name="flav", type="int"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="flav",
+            content=[
+                schema.CategoryItem(key=0, value=0.9),
+                schema.CategoryItem(
+                    key=5,
+                    value=schema.Formula(
+                        nodetype="formula",
+                        expression="1 + 0.001*x",
+                        parser="TFormula",
+                        variables=["pt"],
+                    ),
+                ),
+            ],
+        ),
+    )
+    cset = schema.CorrectionSet(
+        schema_version=2,
+        corrections=[
+            corr("jec", "1 + 0.01*log(x)", ["pt"]),
+            corr("jer", "1 + 0.1*x*y", ["eta", "pt"]),
+            btag,
+        ],
+    )
+    return correctionlib.CorrectionSet(cset)
+
+
+def test_evaluate_many():
+    cset = make_cset()
+    rng = numpy.random.default_rng(7)
+    n = 5000
+    columns = {
+        "syst": "central",
+        "eta": rng.uniform(-3.0, 3.0, n),
+        "pt": rng.uniform(10.0, 200.0, n),
+        "flav": rng.choice([0, 5], n),
+    }
+    out = cset.evaluate_many({name: columns for name in ["jec", "jer", "btag"]})
+    assert list(out) == ["jec", "jer", "btag"]
+    for name, result in out.items():
+        corr = cset[name]
+        args = [columns[var.name] for var in corr.inputs]
+        assert numpy.array_equal(result, corr.evaluate(*args))
+
+    stacked = cset.evaluate_many(
+        {"btag": columns, "jec": {**columns, "syst": "up"}}, stack=True
+    )
+    assert stacked.shape == (2, n)
+    assert numpy.array_equal(stacked[0], out["btag"])
+    assert numpy.all(stacked[1] == 1.2)
+
+    # arguments are broadcast together
+    pt = columns["pt"].reshape(50, 100)
+    out = cset.evaluate_many({"jec": {"syst": "central", "eta": 1.0, "pt": pt}})
+    assert out["jec"].shape == (50, 100)
+    assert numpy.array_equal(out["jec"], cset["jec"].evaluate("central", 1.0, pt))
+
+    # all scalars
+    out = cset.evaluate_many({"btag": {"flav": 5, "pt": 100.0}}, stack=True)
+    assert out.shape == (1,)
+    assert out[0] == cset["btag"].evaluate(5, 100.0)
+
+    with pytest.raises(KeyError):
+        cset.evaluate_many({"jec": {"syst": "central", "pt": 10.0}})
+    with pytest.raises(IndexError):
+        cset.evaluate_many({"nope": columns})
+    with pytest.raises(IndexError):
+        cset.evaluate_many({"btag": {**columns, "flav": 4}})
@@ -0,0 +1,106 @@
+import pickle
+
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_cset(dtype=numpy.float64):
+    corr = schema.Correction(
+        name="sf",
+        version=1,
+        inputs=[
+            schema.Variable(name="eta", type="real"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.MultiBinning(
+            nodetype="multibinning",
+            inputs=["eta", "pt"],
+            edges=[
+                [-2.4, 0.0, 2.4],
+                schema.UniformBinning(n=4, low=20.0, high=100.0),
+            ],
+            content=[
+                (
+                    1.0 + 0.1 * i
+                    if i % 2
+                    else schema.Formula(
+                        nodetype="formula",
+                        expression="1 + 0.001*x",
+                        parser="TFormula",
+                        variables=["pt"],
+                    )
+                )
+                for i in range(8)
+            ],
+            flow="clamp",
+        ),
+    )
+    cset = schema.CorrectionSet(schema_version=2, corrections=[corr])
+    return correctionlib.CorrectionSet(cset, dtype=dtype)
+
+
+def test_float32():
+    rng = numpy.random.default_rng(1)
+    eta = rng.uniform(-3.0, 3.0, 1000).astype(numpy.float32)
+    pt = rng.uniform(10.0, 120.0, 1000).astype(numpy.float32)
+
+    # float32 inputs are read as they are: same results as converting them
+    double = make_cset()["sf"]
+    ref = double.evaluate(eta.astype(numpy.float64), pt.astype(numpy.float64))
+    out = double.evaluate(eta, pt)
+    assert out.dtype == numpy.float64
+    assert numpy.array_equal(out, ref)
+
+    cset = make_cset(numpy.float32)
+    single = cset["sf"]
+    out = single.evaluate(eta, pt)
+    assert out.dtype == numpy.float32
+    assert numpy.array_equal(out, ref.astype(numpy.float32))
+    # strided float32 inputs
+    assert numpy.array_equal(single.evaluate(eta[::2], pt[::2]), out[::2])
+    assert single.evaluate(eta, pt, errors="nan").dtype == numpy.float32
+    values, status = single.evaluate_status(eta, pt)
+    assert values.dtype == numpy.float32
+    assert numpy.array_equal(values, out)
+    assert not status.any()
+
+    cset2 = pickle.loads(pickle.dumps(cset))
+    assert cset2["sf"].evaluate(eta, pt).dtype == numpy.float32
+
+    with pytest.raises(ValueError):
+        make_cset(numpy.int32)
+
+    # 2.4 is not a float32, 0.0 and the uniform edges are
+    report = cset.float32_report()
+    assert [(r["input"], r["edge"]) for r in report] == [
+        ("eta", -2.4),
+        ("eta", 2.4),
+    ]
+    assert report[1]["float32"] == float(numpy.float32(2.4))
+    assert report[1]["correction"] == "sf"
+
+
+def test_float32_report_uniform():
+    corr = schema.Correction(
+        name="uniform",
+        version=1,
+        inputs=[schema.Variable(name="x", type="real")],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Binning(
+            nodetype="binning",
+            input="x",
+            edges=schema.UniformBinning(n=3, low=0.1, high=0.7),
+            content=[1.0, 2.0, 3.0],
+            flow="clamp",
+        ),
+    )
+    cset = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )
+    # only the stored edges, not low + i * width (e.g. 0.30000000000000004)
+    report = cset.float32_report()
+    assert [(r["input"], r["edge"]) for r in report] == [("x", 0.1), ("x", 0.7)]
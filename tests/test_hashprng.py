@@ -1,3 +1,4 @@
+import numpy
 import pytest
 
 import correctionlib
@@ -42,3 +43,42 @@ def test_hashprng():
 
     # we already see two implementations of stdnormal in the CI (the latter on ubuntu)
     assert corr.evaluate(1.2, 2.3, 5) in (0.5320038585132821, 2.227655564267796)
+
+
+# fixed values, which must not change between versions or between the
+# scalar and batch evaluation paths
+REFERENCE = {
+    "normal": [
+        -1.263776278956304,
+        1.0651865177156403,
+        0.21060376873415243,
+        -1.6396609055725968,
+        -1.5708097914563588,
+    ],
+    "stdflat": [
+        0.5312947726732237,
+        0.8586824988021491,
+        0.07623290682881509,
+        0.5514842884749479,
+        0.3964451302991793,
+    ],
+}
+
+
+@pytest.mark.parametrize("distribution", ["normal", "stdflat"])
+def test_hashprng_reproducible(distribution):
+    corr = _make_hashprng_cset(distribution)
+    var1 = numpy.array([1.2, 0.0, -3.5, 1e10, 7.25])
+    var2 = numpy.array([2.3, 0.0, 4.0, -2.0, 0.125])
+    var3 = numpy.array([5, 0, -1, 123456789, 42])
+    expected = REFERENCE[distribution]
+    for i, value in enumerate(expected):
+        assert corr.evaluate(float(var1[i]), float(var2[i]), int(var3[i])) == value
+    assert list(corr.evaluate(var1, var2, var3)) == expected
+
+    # a larger batch, with a broadcast input
+    var1 = numpy.linspace(-100.0, 100.0, 5001)
+    var3 = numpy.arange(5001)
+    out = corr.evaluate(var1, 2.3, var3)
+    for i in range(0, 5001, 97):
+        assert out[i] == corr.evaluate(float(var1[i]), 2.3, int(var3[i]))
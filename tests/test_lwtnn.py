@@ -1,6 +1,7 @@
 import json
 from pathlib import Path
 
+import numpy
 import pytest
 
 from correctionlib.highlevel import CorrectionSet, model_auto, open_auto
@@ -39,3 +40,31 @@ def test_lwtnn_example():
         gen_iso,
     )
     assert sf == 0.95186825355646787
+
+
+@pytest.mark.parametrize(
+    "inputs,expected",
+    [
+        ((30.0, -1.2, 0.5, 0.05), 0.94931109756776277),
+        ((55.5, 2.2, -3.0, 0.2), 0.81463657562963632),
+        ((120.0, 0.0, 1.0, 0.0), 0.96902477371887785),
+        ((8.0, -2.4, -1.5, 0.9), 0.68811476775591285),
+    ],
+)
+def test_lwtnn_reference(inputs, expected):
+    # single evaluations give exactly the outputs of lwt::LightweightNeuralNetwork
+    cset = CorrectionSet.from_file(str(LWTNN_TEST_FIXTURE))
+    corr = cset["electron_fastsim_sf"]
+    assert corr.evaluate(*inputs) == expected
+
+
+def test_lwtnn_batch():
+    cset = CorrectionSet.from_file(str(LWTNN_TEST_FIXTURE))
+    corr = cset["electron_fastsim_sf"]
+
+    gen_pt = numpy.linspace(10.0, 200.0, 1500)
+    gen_eta = numpy.linspace(-2.4, 2.4, 1500)
+    sf = corr.evaluate(gen_pt, gen_eta, 2.1, 1e-3)
+    expected = [corr.evaluate(a, b, 2.1, 1e-3) for a, b in zip(gen_pt, gen_eta)]
+    # each entry is computed with the same products as a single evaluation
+    assert sf.tolist() == expected
@@ -0,0 +1,74 @@
+import numpy
+import pytest
+
+import correctionlib._core as core
+from correctionlib import schemav2 as schema
+
+
+def make_cset(flow):
+    # a 40x40 table where one cell in twenty differs from 1.0, some of them
+    # formulas: stored sparse. In "dense", the common value alternates with
+    # an equal formula, so that it is stored as usual
+    rng = numpy.random.default_rng(3)
+    cells = {
+        int(i): float(v)
+        for i, v in zip(rng.choice(1600, 80, replace=False), rng.uniform(0, 2, 80))
+    }
+
+    def formula(expression):
+        return schema.Formula(
+            nodetype="formula",
+            expression=expression,
+            parser="TFormula",
+            variables=["y"],
+        )
+
+    def content(i, dense):
+        if i in cells:
+            return formula(f"{cells[i]}*y") if i % 3 == 0 else cells[i]
+        return formula("1+0*y") if dense and i % 2 else 1.0
+
+    corrections = [
+        schema.Correction(
+            name=name,
+            version=1,
+            inputs=[
+                schema.Variable(name="x", type="real"),
+                schema.Variable(name="y", type="real"),
+            ],
+            output=schema.Variable(name="weight", type="real"),
+            data=schema.MultiBinning(
+                nodetype="multibinning",
+                inputs=["x", "y"],
+                edges=[
+                    schema.UniformBinning(n=40, low=0.0, high=1.0),
+                    schema.UniformBinning(n=40, low=0.0, high=1.0),
+                ],
+                content=[content(i, name == "dense") for i in range(1600)],
+                flow=flow,
+            ),
+        )
+        for name in ["sparse", "dense"]
+    ]
+    cset = schema.CorrectionSet(schema_version=2, corrections=corrections)
+    return core.CorrectionSet.from_string(cset.model_dump_json())
+
+
+@pytest.mark.parametrize("flow", ["clamp", "error", 0.5])
+def test_sparse_multibinning(flow):
+    # tables where few cells differ from a common constant are stored as
+    # those cells only, and must evaluate as the full table
+    cset = make_cset(flow)
+    sparse, dense = cset["sparse"], cset["dense"]
+    rng = numpy.random.default_rng(7)
+    x = rng.uniform(-0.1, 1.1, 5000)
+    y = rng.uniform(-0.1, 1.1, 5000)
+    inside = (x >= 0.0) & (x < 1.0) & (y >= 0.0) & (y < 1.0)
+    if flow == "error":
+        with pytest.raises(RuntimeError):
+            sparse.evalv(x, y)
+        x, y = x[inside], y[inside]
+    out = sparse.evalv(x, y)
+    assert list(out) == list(dense.evalv(x, y))
+    assert list(out) == [sparse.evaluate(float(a), float(b)) for a, b in zip(x, y)]
+    assert numpy.count_nonzero(out != 1.0) > 100
@@ -0,0 +1,210 @@
+import pickle
+
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_cset():
+    def ptbinning(offset):
+        return schema.Binning(
+            nodetype="binning",
+            input="pt",
+            edges=[20.0, 30.0, 50.0, 100.0],
+            content=[
+                offset,
+                offset + 0.1,
+                schema.Formula(
+                    nodetype="formula",
+                    expression="x*0.001",
+                    parser="TFormula",
+                    variables=["pt"],
+                ),
+            ],
+            flow="clamp",
+        )
+
+    btag = schema.Correction(
+        name="btag",
+        version=1,
+        inputs=[
+            schema.Variable(name="syst", type="string"),
+            schema.Variable(name="flav", type="int"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                schema.CategoryItem(
+                    key="central",
+                    value=schema.Category(
+                        nodetype="category",
+                        input="flav",
+                        content=[
+                            schema.CategoryItem(key=0, value=ptbinning(1.0)),
+                            schema.CategoryItem(key=4, value=ptbinning(2.0)),
+                            schema.CategoryItem(key=5, value=ptbinning(3.0)),
+                        ],
+                    ),
+                ),
+                schema.CategoryItem(
+                    key="up",
+                    value=schema.Category(
+                        nodetype="category",
+                        input="flav",
+                        content=[
+                            schema.CategoryItem(key=0, value=ptbinning(1.5)),
+                            schema.CategoryItem(key=4, value=ptbinning(2.5)),
+                        ],
+                    ),
+                ),
+            ],
+        ),
+    )
+    grid = schema.Correction(
+        name="grid",
+        version=1,
+        inputs=[
+            schema.Variable(name="x", type="real"),
+            schema.Variable(name="y", type="real"),
+            schema.Variable(name="z", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        generic_formulas=[
+            schema.Formula(
+                nodetype="formula",
+                expression="[0] + [1]*x + y*z",
+                parser="TFormula",
+                variables=["x", "y", "z"],
+            )
+        ],
+        data=schema.MultiBinning(
+            nodetype="multibinning",
+            inputs=["x", "y"],
+            edges=[
+                [0.0, 1.0, 2.0, 3.0],
+                schema.UniformBinning(n=2, low=0.0, high=2.0),
+            ],
+            content=[
+                schema.FormulaRef(
+                    nodetype="formularef", index=0, parameters=[float(i), 2.0]
+                )
+                for i in range(6)
+            ],
+            flow=-1.0,
+        ),
+    )
+    rng = schema.Correction(
+        name="rng",
+        version=1,
+        inputs=[
+            schema.Variable(name="event", type="int"),
+            schema.Variable(name="pt", type="real"),
+            schema.Variable(name="scale", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Transform(
+            nodetype="transform",
+            input="pt",
+            rule=schema.Formula(
+                nodetype="formula",
+                expression="x*y",
+                parser="TFormula",
+                variables=["pt", "scale"],
+            ),
+            content=schema.HashPRNG(
+                nodetype="hashprng",
+                inputs=["event", "pt"],
+                distribution="stdnormal",
+            ),
+        ),
+    )
+    return correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[btag, grid, rng])
+    )
+
+
+def test_specialize_category():
+    cset = make_cset()
+    btag = cset["btag"]
+    central = btag.specialize({"syst": "central"})
+    assert [v.name for v in central.inputs] == ["flav", "pt"]
+    for flav in [0, 4, 5]:
+        for pt in [10.0, 25.0, 45.0, 60.0, 500.0]:
+            assert central.evaluate(flav, pt) == btag.evaluate("central", flav, pt)
+
+    both = btag.specialize({"syst": "up", "flav": 4})
+    assert [v.name for v in both.inputs] == ["pt"]
+    pt = numpy.linspace(0.0, 200.0, 101)
+    assert numpy.array_equal(both.evaluate(pt), btag.evaluate("up", 4, pt))
+
+    # missing keys fail as they would when evaluating
+    up = btag.specialize({"syst": "up"})
+    with pytest.raises(IndexError):
+        up.evaluate(5, 25.0)
+    with pytest.raises(IndexError):
+        btag.specialize({"syst": "down"})
+
+    # flavour 5 is only missing for syst=up: keep failing only there
+    b = btag.specialize({"flav": 5})
+    assert b.evaluate("central", 25.0) == btag.evaluate("central", 5, 25.0)
+    with pytest.raises(IndexError):
+        b.evaluate("up", 25.0)
+
+    with pytest.raises(RuntimeError, match="could not find variable"):
+        btag.specialize({"sys": "central"})
+    with pytest.raises(RuntimeError, match="wrong type"):
+        btag.specialize({"flav": "5"})
+
+    # nothing fixed: same correction
+    assert btag.specialize({}).evaluate("up", 0, 25.0) == btag.evaluate("up", 0, 25.0)
+
+
+def test_specialize_multibinning():
+    cset = make_cset()
+    grid = cset["grid"]
+    x = numpy.linspace(-1.0, 4.0, 51)
+    y = numpy.linspace(-1.0, 3.0, 41)
+    X, Y = numpy.meshgrid(x, y)
+    for z in [0.0, 0.5, 3.0]:
+        s = grid.specialize({"z": z})
+        assert [v.name for v in s.inputs] == ["x", "y"]
+        assert numpy.array_equal(s.evaluate(X, Y), grid.evaluate(X, Y, z))
+    for yval in [-1.0, 0.5, 1.5]:
+        s = grid.specialize({"y": yval})
+        assert numpy.array_equal(s.evaluate(x, 2.0), grid.evaluate(x, yval, 2.0))
+    s = grid.specialize({"x": 1.5, "y": 0.5, "z": 2.0})
+    assert s.inputs == []
+    assert s.evaluate() == grid.evaluate(1.5, 0.5, 2.0)
+
+
+def test_specialize_transform_hashprng():
+    cset = make_cset()
+    rng = cset["rng"]
+    event = numpy.arange(1000)
+    pt = numpy.linspace(10.0, 100.0, 1000)
+
+    s = rng.specialize({"scale": 1.1})
+    assert numpy.array_equal(s.evaluate(event, pt), rng.evaluate(event, pt, 1.1))
+
+    s = rng.specialize({"event": 42})
+    assert numpy.array_equal(s.evaluate(pt, 0.9), rng.evaluate(42, pt, 0.9))
+
+    # the value fixed for pt is replaced by the transform
+    s = rng.specialize({"pt": 30.0, "scale": 1.1})
+    assert numpy.array_equal(s.evaluate(event), rng.evaluate(event, 30.0, 1.1))
+    with pytest.raises(ValueError, match="Cannot specialize input pt"):
+        rng.specialize({"pt": 30.0})
+
+
+def test_specialize_pickle():
+    cset = make_cset()
+    s = cset["btag"].specialize({"syst": "central"}).specialize({"flav": 4})
+    assert [v.name for v in s.inputs] == ["pt"]
+    s2 = pickle.loads(pickle.dumps(s))
+    assert [v.name for v in s2.inputs] == ["pt"]
+    assert s2.evaluate(25.0) == s.evaluate(25.0)
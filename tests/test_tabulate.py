@@ -0,0 +1,104 @@
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_corr():
+    def ptbinning(scale):
+        return schema.Binning(
+            nodetype="binning",
+            input="pt",
+            edges=[20.0, 30.0, 50.0, 100.0, 1000.0],
+            content=[
+                scale,
+                schema.Formula(
+                    nodetype="formula",
+                    expression=f"{scale}*log(x)",
+                    parser="TFormula",
+                    variables=["pt"],
+                ),
+                1.5 * scale,
+                2.0 * scale,
+            ],
+            flow="clamp",
+        )
+
+    corr = schema.Correction(
+        name="sf",
+        version=1,
+        inputs=[
+            schema.Variable(name="syst", type="string"),
+            schema.Variable(name="flav", type="int"),
+            schema.Variable(name="eta", type="real"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                schema.CategoryItem(
+                    key=syst,
+                    value=schema.MultiBinning(
+                        nodetype="multibinning",
+                        inputs=["flav", "eta"],
+                        edges=[[0, 4, 5, 6], [-2.5, -1.0, 0.0, 1.0, 2.5]],
+                        content=[
+                            ptbinning(1.0 + 0.1 * i + 0.01 * j)
+                            for j in range(3)
+                            for i in range(4)
+                        ],
+                        flow="clamp",
+                    ),
+                )
+                for syst in ["nominal", "up", "down"]
+            ],
+        ),
+    )
+    cset = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )
+    return cset["sf"]
+
+
+def test_tabulate():
+    # the grid must match evaluating every combination of the points
+    corr = make_corr()
+    eta = numpy.linspace(-3.0, 3.0, 61)
+    pt = numpy.linspace(10.0, 1200.0, 500)
+    systs = ["up", "nominal", "down"]
+    flavs = [0, 4, 5]
+    out = corr.tabulate({"eta": eta, "syst": systs, "pt": pt, "flav": flavs})
+    assert out.shape == (61, 3, 500, 3)
+    _, e, p, f = numpy.meshgrid(numpy.arange(3), eta, pt, flavs, indexing="ij")
+    for k, syst in enumerate(systs):
+        expected = corr.evaluate(syst, f[k], e[k], p[k])
+        assert numpy.array_equal(out[:, k], expected)
+
+    # single values fix an input without adding an axis
+    out = corr.tabulate({"pt": pt, "syst": "up", "flav": 4, "eta": eta})
+    assert out.shape == (500, 61)
+    p, e = numpy.meshgrid(pt, eta, indexing="ij")
+    assert numpy.array_equal(out, corr.evaluate("up", 4, e, p))
+    assert numpy.array_equal(
+        corr.tabulate(
+            {"pt": pt.astype(numpy.float32), "syst": "up", "flav": 4, "eta": 0.5}
+        ),
+        corr.evaluate("up", 4, 0.5, pt.astype(numpy.float32).astype(numpy.float64)),
+    )
+    assert corr.tabulate({"pt": [], "syst": "up", "flav": 4, "eta": eta}).shape == (
+        0,
+        61,
+    )
+
+
+def test_tabulate_errors():
+    corr = make_corr()
+    with pytest.raises(ValueError, match="Missing"):
+        corr.tabulate({"eta": [0.0], "pt": [50.0], "syst": "up"})
+    with pytest.raises(ValueError, match="Unknown"):
+        corr.tabulate({"eta": [0.0], "pt": [50.0], "syst": "up", "flav": 0, "x": 1})
+    with pytest.raises(IndexError):
+        corr.tabulate({"eta": [0.0], "pt": [50.0], "syst": ["up", "other"], "flav": 0})
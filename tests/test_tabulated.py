@@ -0,0 +1,83 @@
+import pickle
+
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_corr():
+    corr = schema.Correction(
+        name="smooth",
+        version=1,
+        inputs=[
+            schema.Variable(name="eta", type="real"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Binning(
+            nodetype="binning",
+            input="eta",
+            edges=[-2.5, 0.0, 2.5],
+            content=[
+                schema.Formula(
+                    nodetype="formula",
+                    expression="1 + 0.5*exp(-x/30)*log(x)",
+                    parser="TFormula",
+                    variables=["pt"],
+                ),
+                schema.Formula(
+                    nodetype="formula",
+                    expression="1 + 0.1*erf((x - 100)/200)*y",
+                    parser="TFormula",
+                    variables=["pt", "eta"],
+                ),
+            ],
+            flow="error",
+        ),
+    )
+    cset = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )
+    return cset["smooth"]
+
+
+def test_tabulated():
+    corr = make_corr()
+    tab, report = corr.tabulated(1e-3, {"pt": (15.0, 1500.0)})
+    assert [r["inputs"] for r in report] == [["pt"], ["eta", "pt"]]
+    assert all(r["tabulated"] for r in report)
+    # the eta domain comes from the bin edges
+    assert report[1]["domain"] == [(0.0, 2.5), (15.0, 1500.0)]
+    for r in report:
+        assert r["max_error"] <= 1e-3
+        assert r["bytes"] == 8 * r["points"]
+
+    rng = numpy.random.default_rng(7)
+    eta = rng.uniform(-2.5, 2.5, 5000)
+    pt = rng.uniform(10.0, 2000.0, 5000)
+    exact = corr.evaluate(eta, pt)
+    out = tab.evaluate(eta, pt)
+    assert numpy.abs(out - exact).max() <= 1e-3
+    # outside of the grid, the formulas are evaluated
+    outside = (pt < 15.0) | (pt > 1500.0)
+    assert numpy.array_equal(out[outside], exact[outside])
+
+    # too strict: nothing is tabulated
+    same, report = corr.tabulated(1e-15, {"pt": (15.0, 1500.0)}, max_points=1000)
+    assert not any(r["tabulated"] for r in report)
+    assert numpy.array_equal(same.evaluate(eta, pt), exact)
+
+    tab2 = pickle.loads(pickle.dumps(tab))
+    assert numpy.array_equal(tab2.evaluate(eta, pt), out)
+    # specialized after tabulation, which pickle must replay in that order
+    special = tab.specialize({"eta": 1.0}).cached(64)
+    again = pickle.loads(pickle.dumps(special))
+    assert numpy.array_equal(again.evaluate(pt), special.evaluate(pt))
+    assert again.cache_stats["capacity"] == 64
+
+    with pytest.raises(ValueError):
+        corr.tabulated(0.0, {})
+    with pytest.raises(ValueError):
+        corr.tabulated(1e-3, {"pt": (2.0, 1.0)})
@@ -1,3 +1,5 @@
+import numpy
+
 import correctionlib._core as core
 from correctionlib import schemav2 as schema
 
@@ -68,3 +70,9 @@ def test_transform_nested_rule_and_content():
     #   inner rule transform x->2 then x+y => 2+4 = 6, so y becomes 6
     # final content: x+y = 4+6 = 10
     assert corr.evaluate(3.0, 4.0) == 10.0
+
+    # the batch path transforms whole columns
+    x = numpy.linspace(-2.0, 5.0, 15)
+    y = numpy.linspace(0.0, 3.0, 15)
+    assert list(corr.evalv(x, y)) == [corr.evaluate(a, b) for a, b in zip(x, y)]
+    assert list(corr.evalv(x, 4.0)) == [corr.evaluate(a, 4.0) for a in x]
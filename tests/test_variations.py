@@ -0,0 +1,173 @@
+import awkward
+import numpy
+import pytest
+
+import correctionlib
+from correctionlib import schemav2 as schema
+
+
+def make_corr():
+    def binning(shift, formula=False, edges=(-2.5, -1.0, 0.0, 1.0, 2.5)):
+        return schema.MultiBinning(
+            nodetype="multibinning",
+            inputs=["eta", "pt"],
+            edges=[list(edges), [20.0, 50.0, 100.0]],
+            content=[
+                (
+                    schema.Formula(
+                        nodetype="formula",
+                        expression=f"{1.0 + shift} + 0.001*x",
+                        parser="TFormula",
+                        variables=["pt"],
+                    )
+                    if formula and i % 2
+                    else 1.0 + shift + 0.1 * i
+                )
+                for i in range(2 * (len(edges) - 1))
+            ],
+            flow="clamp",
+        )
+
+    corr = schema.Correction(
+        name="jec",
+        version=1,
+        inputs=[
+            schema.Variable(name="eta", type="real"),
+            schema.Variable(name="syst", type="string"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                schema.CategoryItem(key=f"v{k}", value=binning(0.01 * k, k % 5 == 0))
+                for k in range(20)
+            ]
+            + [
+                schema.CategoryItem(
+                    key="odd", value=binning(0.5, True, (-2.5, 0.0, 2.5))
+                )
+            ],
+            default=1.0,
+        ),
+    )
+    cset = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )
+    return cset["jec"]
+
+
+def test_variations():
+    corr = make_corr()
+    rng = numpy.random.default_rng(5)
+    eta = rng.uniform(-3.0, 3.0, (30, 100))
+    pt = rng.uniform(10.0, 150.0, (30, 100))
+    # shared binning, constant and formula contents, the default, and a key
+    # with a different binning
+    keys = [f"v{k}" for k in range(20)] + ["unknown", "odd"]
+    out = corr.evaluate_variations("syst", keys, eta, pt)
+    assert out.shape == (len(keys), 30, 100)
+    for key, result in zip(keys, out):
+        assert numpy.array_equal(result, corr.evaluate(eta, key, pt))
+
+    # only keys with the same binning: routed once for all of them
+    keys = [f"v{k}" for k in range(20)]
+    out = corr.evaluate_variations("syst", keys, eta, pt)
+    for key, result in zip(keys, out):
+        assert numpy.array_equal(result, corr.evaluate(eta, key, pt))
+
+    out = corr.evaluate_variations("syst", ["v1", "odd"], 0.5, 30.0)
+    assert list(out) == [corr.evaluate(0.5, key, 30.0) for key in ["v1", "odd"]]
+
+    # jagged arrays, with the axis over the keys innermost
+    counts = rng.integers(0, 5, 200)
+    jeta = awkward.unflatten(eta.ravel()[: counts.sum()], counts)
+    jpt = awkward.unflatten(pt.ravel()[: counts.sum()], counts)
+    out = corr.evaluate_variations("syst", keys, jeta, jpt)
+    for k, key in enumerate(keys):
+        assert awkward.to_list(out[..., k]) == awkward.to_list(
+            corr.evaluate(jeta, key, jpt)
+        )
+
+    with pytest.raises(ValueError):
+        corr.evaluate_variations("eta", ["v1"], eta, pt)
+    with pytest.raises(ValueError):
+        corr.evaluate_variations("syst", ["v1"], eta)
+
+
+def make_sparse_corr():
+    # 20x20 tables where few cells differ from 1.0, stored sparse, with the
+    # same edges for every key. The "f" keys have formula cells.
+    rng = numpy.random.default_rng(7)
+
+    def table(k, formula):
+        cells = set(rng.choice(400, 20, replace=False).tolist())
+        return schema.MultiBinning(
+            nodetype="multibinning",
+            inputs=["eta", "pt"],
+            edges=[
+                schema.UniformBinning(n=20, low=-2.5, high=2.5),
+                schema.UniformBinning(n=20, low=20.0, high=220.0),
+            ],
+            content=[
+                (
+                    (
+                        schema.Formula(
+                            nodetype="formula",
+                            expression=f"{1.0 + 0.01 * k} + 0.001*x",
+                            parser="TFormula",
+                            variables=["pt"],
+                        )
+                        if formula and i % 2
+                        else 1.0 + 0.01 * k + 0.001 * i
+                    )
+                    if i in cells
+                    else 1.0
+                )
+                for i in range(400)
+            ],
+            flow="clamp",
+        )
+
+    corr = schema.Correction(
+        name="sparse",
+        version=1,
+        inputs=[
+            schema.Variable(name="eta", type="real"),
+            schema.Variable(name="syst", type="string"),
+            schema.Variable(name="pt", type="real"),
+        ],
+        output=schema.Variable(name="weight", type="real"),
+        data=schema.Category(
+            nodetype="category",
+            input="syst",
+            content=[
+                schema.CategoryItem(key=f"{kind}{k}", value=table(k, kind == "f"))
+                for kind in ["c", "f"]
+                for k in range(5)
+            ],
+        ),
+    )
+    cset = correctionlib.CorrectionSet(
+        schema.CorrectionSet(schema_version=2, corrections=[corr])
+    )
+    return cset["sparse"]
+
+
+@pytest.mark.parametrize(
+    "keys",
+    [
+        [f"c{k}" for k in range(5)],
+        [f"{kind}{k}" for kind in ["c", "f"] for k in range(5)],
+    ],
+)
+def test_variations_sparse(keys):
+    # a shared sparse MultiBinning, with constant or mixed contents
+    corr = make_sparse_corr()
+    rng = numpy.random.default_rng(11)
+    eta = rng.uniform(-3.0, 3.0, 5000)
+    pt = rng.uniform(10.0, 250.0, 5000)
+    out = corr.evaluate_variations("syst", keys, eta, pt)
+    for key, result in zip(keys, out):
+        assert numpy.array_equal(result, corr.evaluate(eta, key, pt))